@@ -0,0 +1,107 @@
+// pd::atomic_optional against pd::optional guarded by std::mutex under
+// contention: every thread alternately takes a value out of one shared
+// slot or fills it when empty. ns/op is wall time per hand-off attempt
+// across all threads
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/atomic_optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+struct ticket
+{
+    std::uint32_t id;
+    std::uint32_t producer;
+    std::uint32_t payload;
+};
+
+template<typename T>
+struct locked_optional
+{
+    pd::optional<T> take()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        pd::optional<T> result = value_;
+        value_.reset();
+        return result;
+    }
+
+    bool emplace_if_empty(const T &t)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (value_.has_value())
+            return false;
+        value_.emplace(t);
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    pd::optional<T> value_;
+};
+
+template<typename T>
+T make(std::uint32_t seed)
+{
+    if constexpr (std::is_same<T, ticket>::value)
+        return ticket{seed, seed, seed};
+    else
+        return static_cast<T>(seed);
+}
+
+template<typename Slot, typename T>
+double handoff(unsigned threads)
+{
+    return bench::ns_per_op([&](std::size_t n)
+    {
+        Slot slot;
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t)
+            pool.emplace_back([&slot, n, t]
+            {
+                std::size_t taken = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    if (auto v = slot.take())
+                        ++taken;
+                    else
+                        slot.emplace_if_empty(make<T>(t));
+                }
+                bench::do_not_optimize(taken);
+            });
+        for (auto &th : pool)
+            th.join();
+    }) / threads;
+}
+
+template<typename T>
+void run(bench::reporter &out, const char *type, unsigned threads)
+{
+    const std::string op = "handoff_t" + std::to_string(threads);
+    out.report<pd::atomic_optional<T>>("atomic", "atomic", type, op,
+                                       handoff<pd::atomic_optional<T>, T>(threads));
+    out.report<locked_optional<T>>("atomic", "mutex", type, op,
+                                   handoff<locked_optional<T>, T>(threads));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= std::max(cores, 4u); threads *= 2)
+    {
+        run<std::uint32_t>(out, "uint32", threads);
+        run<ticket>(out, "ticket", threads);
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#ifndef PD_OPTIONAL_BENCH_BENCH_HH_
+#define PD_OPTIONAL_BENCH_BENCH_HH_
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// minimal self contained benchmark harness shared by bench/*.cc
+namespace bench
+{
+
+// keeps value alive and opaque for the optimizer. Only the address
+// escapes, so the object is not reloaded into a register which would
+// add store forwarding stalls to small multi-member objects
+template<typename T>
+inline void do_not_optimize(const T &t)
+{
+    asm volatile("" : : "r"(&t) : "memory");
+}
+
+inline void clobber_memory()
+{
+    asm volatile("" : : : "memory");
+}
+
+// runs f(iterations) with growing iteration count until single run takes
+// at least min_time, then returns best ns per iteration out of few runs
+template<typename F>
+double ns_per_op(F &&f, std::chrono::nanoseconds min_time = std::chrono::milliseconds(20))
+{
+    using clock = std::chrono::steady_clock;
+    std::size_t iterations = 1;
+    for (;;)
+    {
+        const auto start = clock::now();
+        f(iterations);
+        const auto elapsed = clock::now() - start;
+        if (elapsed >= min_time || iterations >= (std::size_t(1) << 40))
+            break;
+        iterations *= 2;
+    }
+    double best = 0;
+    for (int run = 0; run < 5; ++run)
+    {
+        const auto start = clock::now();
+        f(iterations);
+        const double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count()
+            / static_cast<double>(iterations);
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+// reporter prints human readable table by default and one JSON object
+// per line with --json, so results can be diffed between revisions
+struct reporter
+{
+    reporter(int argc, char **argv)
+    {
+        for (int i = 1; i < argc; ++i)
+            if (!std::strcmp(argv[i], "--json"))
+                json_ = true;
+    }
+
+    void report(const std::string &suite, const std::string &impl, const std::string &type,
+                const std::string &op, double ns, std::size_t size, std::size_t align,
+                bool trivially_copyable)
+    {
+        if (json_)
+            std::printf("{\"suite\":\"%s\",\"impl\":\"%s\",\"type\":\"%s\",\"op\":\"%s\","
+                        "\"ns_per_op\":%.4f,\"sizeof\":%zu,\"alignof\":%zu,"
+                        "\"trivially_copyable\":%s}\n",
+                        suite.c_str(), impl.c_str(), type.c_str(), op.c_str(), ns, size, align,
+                        trivially_copyable ? "true" : "false");
+        else
+            std::printf("%-10s %-4s %-14s %-22s %10.3f ns/op  size=%-4zu align=%-3zu %s\n",
+                        suite.c_str(), impl.c_str(), type.c_str(), op.c_str(), ns, size, align,
+                        trivially_copyable ? "trivially_copyable" : "");
+    }
+
+    // memory footprint of a whole structure instead of timing
+    void report_memory(const std::string &suite, const std::string &impl, const std::string &type,
+                       const std::string &op, std::size_t bytes)
+    {
+        if (json_)
+            std::printf("{\"suite\":\"%s\",\"impl\":\"%s\",\"type\":\"%s\",\"op\":\"%s\","
+                        "\"bytes\":%zu}\n",
+                        suite.c_str(), impl.c_str(), type.c_str(), op.c_str(), bytes);
+        else
+            std::printf("%-10s %-4s %-14s %-22s %10.3f MiB\n",
+                        suite.c_str(), impl.c_str(), type.c_str(), op.c_str(),
+                        static_cast<double>(bytes) / (1 << 20));
+    }
+
+    // heap allocations per operation, counted by the benchmark itself
+    void report_allocations(const std::string &suite, const std::string &impl, const std::string &type,
+                            const std::string &op, double allocations)
+    {
+        if (json_)
+            std::printf("{\"suite\":\"%s\",\"impl\":\"%s\",\"type\":\"%s\",\"op\":\"%s\","
+                        "\"allocations_per_op\":%.4f}\n",
+                        suite.c_str(), impl.c_str(), type.c_str(), op.c_str(), allocations);
+        else
+            std::printf("%-10s %-4s %-14s %-22s %10.3f allocs/op\n",
+                        suite.c_str(), impl.c_str(), type.c_str(), op.c_str(), allocations);
+    }
+
+    template<typename T>
+    void report(const std::string &suite, const std::string &impl, const std::string &type,
+                const std::string &op, double ns)
+    {
+        report(suite, impl, type, op, ns, sizeof(T), alignof(T),
+               std::is_trivially_copyable<T>::value);
+    }
+
+private:
+    bool json_ = false;
+};
+
+} // namespace bench
+
+#endif // PD_OPTIONAL_BENCH_BENCH_HH_
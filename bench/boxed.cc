@@ -0,0 +1,94 @@
+// pd::boxed_optional<BigStats> against inline pd::optional<BigStats>,
+// BigStats being 2KiB and engaged in one record of twenty. Footprint is
+// bytes of records plus boxes of engaged ones. Allocation latency is one
+// emplace and reset, also against std::unique_ptr which boxes through
+// malloc. Scan counts engaged optionals of all records, ns/op is per
+// record
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/boxed_optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+struct BigStats
+{
+    double sums[256];
+};
+
+template<typename Opt>
+struct Record
+{
+    std::uint64_t id;
+    Opt stats;
+};
+
+constexpr std::size_t records = 1 << 14;
+
+template<typename Opt>
+void run(bench::reporter &out, const char *impl, std::size_t box_bytes)
+{
+    std::mt19937 gen(41);
+    std::vector<Record<Opt>> table(records);
+    std::size_t engaged = 0;
+    for (std::size_t i = 0; i < records; ++i)
+    {
+        table[i].id = i;
+        if (gen() % 20 == 0)
+        {
+            table[i].stats.emplace();
+            ++engaged;
+        }
+    }
+    out.report_memory("boxed", impl, "BigStats", "footprint",
+                      records * sizeof(Record<Opt>) + engaged * box_bytes);
+
+    out.report<Opt>("boxed", impl, "BigStats", "scan", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::size_t count = 0;
+            for (const auto &r : table)
+                count += static_cast<bool>(r.stats);
+            bench::do_not_optimize(count);
+        }
+    }) / records);
+
+    Opt opt;
+    out.report<Opt>("boxed", impl, "BigStats", "emplace_reset", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            opt.emplace();
+            bench::do_not_optimize(opt);
+            opt.reset();
+        }
+    }));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    run<pd::optional<BigStats>>(out, "pd", 0);
+    run<pd::boxed_optional<BigStats>>(out, "box", sizeof(pd::detail::box_pool_of_<BigStats>::block));
+
+    // unique_ptr is no optional, heap box reference for emplace_reset only
+    std::unique_ptr<BigStats> heap;
+    out.report<std::unique_ptr<BigStats>>("boxed", "heap", "BigStats", "emplace_reset",
+                                          bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            heap = std::make_unique<BigStats>();
+            bench::do_not_optimize(heap);
+            heap.reset();
+        }
+    }));
+    return 0;
+}
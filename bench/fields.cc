@@ -0,0 +1,157 @@
+// message with many optional fields as pd::optional_fields against the
+// same fields as separate pd::optional members. Reports sizeof and per
+// message cost of copying a batch and counting set fields
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/optional_fields.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t messages = 4096;
+
+template<std::size_t, typename T>
+using always_ = T;
+
+template<typename T, std::size_t... I>
+pd::optional_fields<always_<I, T>...> repeat_fields(std::index_sequence<I...>);
+
+// N fields of the same type
+template<typename T, std::size_t N>
+using uniform_fields = decltype(repeat_fields<T>(std::make_index_sequence<N>()));
+
+template<typename T, std::size_t N>
+using uniform_optionals = std::array<pd::optional<T>, N>;
+
+// mixed message, field order as a schema would list them
+struct mixed_optionals
+{
+    pd::optional<std::int32_t> id;
+    pd::optional<double> price;
+    pd::optional<bool> active;
+    pd::optional<std::int64_t> created;
+    pd::optional<std::int16_t> region;
+    pd::optional<double> discount;
+    pd::optional<std::uint8_t> flags;
+    pd::optional<std::int32_t> owner;
+    pd::optional<float> weight;
+    pd::optional<std::int64_t> updated;
+};
+
+using mixed_fields = pd::optional_fields<std::int32_t, double, bool, std::int64_t, std::int16_t,
+                                         double, std::uint8_t, std::int32_t, float, std::int64_t>;
+
+template<typename T, std::size_t... I>
+void fill(std::array<pd::optional<T>, sizeof...(I)> &m, std::mt19937 &gen, std::index_sequence<I...>)
+{
+    ((gen() % 2 ? (void)m[I].emplace(static_cast<T>(gen())) : void()), ...);
+}
+
+template<typename... Ts, std::size_t... I>
+void fill(pd::optional_fields<Ts...> &m, std::mt19937 &gen, std::index_sequence<I...>)
+{
+    using fields = pd::optional_fields<Ts...>;
+    ((gen() % 2 ? (void)m.template emplace<I>(static_cast<typename fields::template field_type<I>>(gen())) : void()), ...);
+}
+
+void fill(mixed_optionals &m, std::mt19937 &gen, std::index_sequence<>)
+{
+    if (gen() % 2) m.id = 1;
+    if (gen() % 2) m.price = 2.5;
+    if (gen() % 2) m.active = true;
+    if (gen() % 2) m.created = 4;
+    if (gen() % 2) m.region = 5;
+    if (gen() % 2) m.discount = 0.5;
+    if (gen() % 2) m.flags = 7;
+    if (gen() % 2) m.owner = 8;
+    if (gen() % 2) m.weight = 9.0f;
+    if (gen() % 2) m.updated = 10;
+}
+
+void fill(mixed_fields &m, std::mt19937 &gen, std::index_sequence<>)
+{
+    if (gen() % 2) m.emplace<0>(1);
+    if (gen() % 2) m.emplace<1>(2.5);
+    if (gen() % 2) m.emplace<2>(true);
+    if (gen() % 2) m.emplace<3>(4);
+    if (gen() % 2) m.emplace<4>(5);
+    if (gen() % 2) m.emplace<5>(0.5);
+    if (gen() % 2) m.emplace<6>(7);
+    if (gen() % 2) m.emplace<7>(8);
+    if (gen() % 2) m.emplace<8>(9.0f);
+    if (gen() % 2) m.emplace<9>(10);
+}
+
+template<typename T, std::size_t N>
+std::size_t count_set(const uniform_optionals<T, N> &m)
+{
+    std::size_t n = 0;
+    for (const auto &o : m)
+        n += o.has_value();
+    return n;
+}
+
+std::size_t count_set(const mixed_optionals &m)
+{
+    return m.id.has_value() + m.price.has_value() + m.active.has_value() + m.created.has_value()
+        + m.region.has_value() + m.discount.has_value() + m.flags.has_value() + m.owner.has_value()
+        + m.weight.has_value() + m.updated.has_value();
+}
+
+template<typename... Ts>
+std::size_t count_set(const pd::optional_fields<Ts...> &m)
+{
+    return m.count();
+}
+
+template<typename Message, typename Seq>
+void run(bench::reporter &out, const char *impl, const char *type, Seq seq)
+{
+    std::mt19937 gen(3);
+    std::vector<Message> src(messages);
+    for (auto &m : src)
+        fill(m, gen, seq);
+    std::vector<Message> dst(messages);
+
+    out.report<Message>("fields", impl, type, "copy_batch", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(src);
+            dst = src;
+            bench::do_not_optimize(dst);
+        }
+    }) / messages);
+
+    out.report<Message>("fields", impl, type, "count_set", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(src);
+            std::size_t total = 0;
+            for (const auto &m : src)
+                total += count_set(m);
+            bench::do_not_optimize(total);
+        }
+    }) / messages);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    run<uniform_optionals<std::int32_t, 40>>(out, "optional", "40x int32", std::make_index_sequence<40>());
+    run<uniform_fields<std::int32_t, 40>>(out, "fields", "40x int32", std::make_index_sequence<40>());
+    run<uniform_optionals<double, 20>>(out, "optional", "20x double", std::make_index_sequence<20>());
+    run<uniform_fields<double, 20>>(out, "fields", "20x double", std::make_index_sequence<20>());
+    run<mixed_optionals>(out, "optional", "mixed10", std::index_sequence<>());
+    run<mixed_fields>(out, "fields", "mixed10", std::index_sequence<>());
+    return 0;
+}
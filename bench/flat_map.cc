@@ -0,0 +1,101 @@
+// pd::flat_map against std::unordered_map on 1M random uint64 keys:
+// insert into empty map, successful and failed find, erase of every
+// key. ns/op is per key
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/flat_map.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t keys = 1 << 20;
+
+template<typename Map>
+void run(bench::reporter &out, const char *impl, const std::vector<std::uint64_t> &present,
+         const std::vector<std::uint64_t> &absent)
+{
+    using entry = typename Map::value_type;
+    const char *type = "u64->u64";
+
+    out.report<entry>("flat_map", impl, type, "insert", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Map map;
+            for (std::uint64_t k : present)
+                map[k] = k;
+            bench::do_not_optimize(map);
+        }
+    }) / keys);
+
+    Map map;
+    for (std::uint64_t k : present)
+        map[k] = k;
+
+    out.report<entry>("flat_map", impl, type, "find_hit", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::uint64_t acc = 0;
+            for (std::uint64_t k : present)
+                acc += map.find(k)->second;
+            bench::do_not_optimize(acc);
+        }
+    }) / keys);
+
+    out.report<entry>("flat_map", impl, type, "find_miss", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::size_t found = 0;
+            for (std::uint64_t k : absent)
+                found += map.find(k) != map.end();
+            bench::do_not_optimize(found);
+        }
+    }) / keys);
+
+    // erase needs a full map each round, copy is excluded from timing
+    // by measuring copy alone and subtracting it
+    const double copy = bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Map victim = map;
+            bench::do_not_optimize(victim);
+        }
+    });
+    const double copy_erase = bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            Map victim = map;
+            for (std::uint64_t k : present)
+                victim.erase(k);
+            bench::do_not_optimize(victim);
+        }
+    });
+    out.report<entry>("flat_map", impl, type, "erase", (copy_erase - copy) / keys);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    std::mt19937_64 gen(23);
+    std::vector<std::uint64_t> present(keys);
+    std::vector<std::uint64_t> absent(keys);
+    // odd keys present, even ones absent, so sets never overlap
+    for (std::size_t i = 0; i < keys; ++i)
+    {
+        present[i] = gen() | 1;
+        absent[i] = gen() & ~std::uint64_t(1);
+    }
+    run<std::unordered_map<std::uint64_t, std::uint64_t>>(out, "unordered_map", present, absent);
+    run<pd::flat_map<std::uint64_t, std::uint64_t>>(out, "flat_map", present, absent);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// persisting optional columns: streaming pd::column_writer and mmap based
+// pd::mapped_column against per element records written and parsed back
+// into std::vector<pd::optional<T>>. ns/op is per element of the column,
+// files are in page cache so this measures CPU side of the load step
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/optional_io.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t elements = 1 << 22;
+
+const char *column_path = "bench_io_column.bin";
+const char *records_path = "bench_io_records.bin";
+
+// what snapshot code did before: one flag byte and value per element
+void write_records(const std::vector<pd::optional<double>> &column)
+{
+    std::FILE *f = std::fopen(records_path, "wb");
+    for (const auto &o : column)
+    {
+        const unsigned char flag = o.has_value();
+        std::fwrite(&flag, 1, 1, f);
+        if (flag)
+            std::fwrite(&*o, sizeof(double), 1, f);
+    }
+    std::fclose(f);
+}
+
+std::vector<pd::optional<double>> read_records()
+{
+    std::vector<pd::optional<double>> column;
+    column.reserve(elements);
+    std::FILE *f = std::fopen(records_path, "rb");
+    unsigned char flag;
+    while (std::fread(&flag, 1, 1, f) == 1)
+    {
+        double value;
+        if (flag && std::fread(&value, sizeof(double), 1, f) == 1)
+            column.emplace_back(value);
+        else
+            column.emplace_back();
+    }
+    std::fclose(f);
+    return column;
+}
+
+void write_column(const std::vector<pd::optional<double>> &column)
+{
+    pd::column_writer<double> writer(column_path);
+    for (const auto &o : column)
+        writer.push_back(o);
+    writer.finish();
+}
+
+template<typename F>
+double per_element(F &&f)
+{
+    return bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            f();
+    }, std::chrono::milliseconds(200)) / elements;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    std::mt19937_64 gen(5);
+    std::vector<pd::optional<double>> column(elements);
+    for (auto &o : column)
+        if (gen() % 4)
+            o = static_cast<double>(gen() % 1000) * 0.25;
+
+    using opt = pd::optional<double>;
+    out.report<opt>("io", "records", "double", "write", per_element([&] { write_records(column); }));
+    out.report<opt>("io", "column", "double", "write", per_element([&] { write_column(column); }));
+
+    out.report<opt>("io", "records", "double", "load", per_element([&]
+    {
+        auto loaded = read_records();
+        bench::do_not_optimize(loaded);
+    }));
+    out.report<opt>("io", "column", "double", "load", per_element([&]
+    {
+        pd::mapped_column<double> mapped(column_path);
+        bench::do_not_optimize(mapped);
+    }));
+
+    out.report<opt>("io", "records", "double", "load_and_sum", per_element([&]
+    {
+        double sum = 0;
+        for (const auto &o : read_records())
+            sum += o.value_or(0);
+        bench::do_not_optimize(sum);
+    }));
+    out.report<opt>("io", "column", "double", "load_and_sum", per_element([&]
+    {
+        pd::mapped_column<double> mapped(column_path);
+        double sum = 0;
+        for (std::size_t i = 0; i < mapped.size(); ++i)
+            sum += mapped[i].value_or(0);
+        bench::do_not_optimize(sum);
+    }));
+
+    std::remove(column_path);
+    std::remove(records_path);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Column kernels against naive loops over std::vector<pd::optional<T>>,
+// ns/op is reported per column element
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/optional_vector.hh"
+#include "../include/pd/optional_kernels.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t elements = 1 << 22;
+
+const char* level_name(pd::simd_level level)
+{
+    switch (level)
+    {
+    case pd::simd_level::scalar: return "scalar";
+    case pd::simd_level::sse2: return "sse2";
+    case pd::simd_level::avx2: return "avx2";
+    case pd::simd_level::avx512: return "avx512";
+    }
+    return "?";
+}
+
+template<typename F>
+double ns_per_element(F &&f)
+{
+    return bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            auto r = f();
+            bench::do_not_optimize(r);
+        }
+    }) / elements;
+}
+
+template<typename T>
+void run(bench::reporter &out, const char *type, double fill)
+{
+    std::mt19937_64 rng(42);
+    std::bernoulli_distribution engaged(fill);
+    std::vector<pd::optional<T>> rows(elements);
+    pd::optional_vector<T> col;
+    col.reserve(elements);
+    for (std::size_t i = 0; i < elements; ++i)
+    {
+        if (engaged(rng))
+        {
+            const T t = static_cast<T>(rng() % 1000);
+            rows[i] = t;
+            col.push_back(t);
+        }
+        else
+            col.push_back(pd::nullopt);
+    }
+    std::vector<T> buf(elements);
+
+    const std::string suite = "kernels_" + std::to_string(static_cast<int>(fill * 100));
+    auto report = [&](const char *impl, const char *op, double ns)
+    {
+        out.report<pd::optional<T>>(suite, impl, type, op, ns);
+    };
+
+    report("naive", "sum", ns_per_element([&]
+    {
+        T acc = 0;
+        for (const auto &o : rows)
+            if (o.has_value())
+                acc += *o;
+        return acc;
+    }));
+    report("naive", "max", ns_per_element([&]
+    {
+        pd::optional<T> acc;
+        for (const auto &o : rows)
+            if (o.has_value() && (!acc.has_value() || *o > *acc))
+                acc = *o;
+        return acc.value_or(0);
+    }));
+    report("naive", "count", ns_per_element([&]
+    {
+        std::size_t n = 0;
+        for (const auto &o : rows)
+            n += o.has_value();
+        return n;
+    }));
+    report("naive", "value_or", ns_per_element([&]
+    {
+        for (std::size_t i = 0; i < elements; ++i)
+            buf[i] = rows[i].value_or(T(-1));
+        return buf[elements / 2];
+    }));
+    report("naive", "compact", ns_per_element([&]
+    {
+        std::size_t n = 0;
+        for (const auto &o : rows)
+            if (o.has_value())
+                buf[n++] = *o;
+        return n;
+    }));
+
+    const pd::simd_level levels[] = {pd::simd_level::scalar, pd::simd_level::sse2,
+                                     pd::simd_level::avx2, pd::simd_level::avx512};
+    for (pd::simd_level level : levels)
+    {
+        if (level > pd::active_simd_level())
+            break;
+        const char *impl = level_name(level);
+        report(impl, "sum", ns_per_element([&] { return pd::sum(col, level); }));
+        report(impl, "max", ns_per_element([&] { return pd::max(col, level).value_or(0); }));
+        report(impl, "count", ns_per_element([&] { return pd::count_engaged(col, level); }));
+        report(impl, "value_or", ns_per_element([&]
+        {
+            pd::fill_value_or(col, T(-1), buf.data(), level);
+            return buf[elements / 2];
+        }));
+        report(impl, "compact", ns_per_element([&] { return pd::compact(col, buf.data(), level); }));
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    for (double fill : {0.5, 0.95})
+    {
+        run<int>(out, "int", fill);
+        run<double>(out, "double", fill);
+    }
+    return 0;
+}
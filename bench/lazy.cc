@@ -0,0 +1,184 @@
+// request parsing with rarely read fields computed eagerly against the
+// same fields wrapped into pd::lazy and pd::sync_lazy. Only a small share
+// of requests reads them, ns/op is per parsed request
+#include <cctype>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../include/pd/lazy.hh"
+#include "bench.hh"
+
+namespace
+{
+
+using string_map = std::map<std::string, std::string>;
+
+std::string lower(std::string_view s)
+{
+    std::string out(s);
+    for (char &c : out)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+// splits "k1<kv>v1<sep>k2<kv>v2" into a map
+string_map split_pairs(std::string_view s, char sep, char kv)
+{
+    string_map out;
+    while (!s.empty())
+    {
+        const std::size_t end = std::min(s.find(sep), s.size());
+        const std::string_view item = s.substr(0, end);
+        const std::size_t eq = std::min(item.find(kv), item.size());
+        std::string_view value = item.substr(std::min(eq + 1, item.size()));
+        while (!value.empty() && value.front() == ' ')
+            value.remove_prefix(1);
+        std::string_view key = item.substr(0, eq);
+        while (!key.empty() && key.front() == ' ')
+            key.remove_prefix(1);
+        out.emplace(lower(key), std::string(value));
+        s.remove_prefix(std::min(end + 1, s.size()));
+    }
+    return out;
+}
+
+struct parse_headers
+{
+    std::string_view raw;
+    string_map operator()() const { return split_pairs(raw, '\n', ':'); }
+};
+
+struct parse_query
+{
+    std::string_view raw;
+    string_map operator()() const { return split_pairs(raw, '&', '='); }
+};
+
+struct parse_cookies
+{
+    std::string_view raw;
+    string_map operator()() const { return split_pairs(raw, ';', '='); }
+};
+
+struct raw_parts
+{
+    std::string_view method, path, query, headers, cookies;
+};
+
+// request line, headers separated by \n, cookie header last
+raw_parts split(std::string_view raw)
+{
+    raw_parts p;
+    const std::size_t line_end = raw.find('\n');
+    std::string_view line = raw.substr(0, line_end);
+    p.method = line.substr(0, line.find(' '));
+    std::string_view target = line.substr(p.method.size() + 1);
+    target = target.substr(0, target.find(' '));
+    const std::size_t q = std::min(target.find('?'), target.size());
+    p.path = target.substr(0, q);
+    p.query = target.substr(std::min(q + 1, target.size()));
+    std::string_view rest = raw.substr(line_end + 1);
+    const std::size_t cookie = rest.rfind("Cookie:");
+    p.headers = rest.substr(0, cookie);
+    p.cookies = rest.substr(cookie + 7);
+    return p;
+}
+
+struct eager_request
+{
+    explicit eager_request(std::string_view raw)
+    {
+        const raw_parts p = split(raw);
+        method = p.method;
+        path = p.path;
+        headers = parse_headers{p.headers}();
+        query = parse_query{p.query}();
+        cookies = parse_cookies{p.cookies}();
+    }
+
+    std::string method, path;
+    string_map headers, query, cookies;
+};
+
+template<bool ThreadSafe>
+struct lazy_request
+{
+    explicit lazy_request(std::string_view raw)
+        : lazy_request(split(raw)) {}
+
+    explicit lazy_request(const raw_parts &p)
+        : method(p.method), path(p.path),
+          headers(parse_headers{p.headers}), query(parse_query{p.query}), cookies(parse_cookies{p.cookies}) {}
+
+    std::string method, path;
+    pd::lazy<string_map, parse_headers, ThreadSafe> headers;
+    pd::lazy<string_map, parse_query, ThreadSafe> query;
+    pd::lazy<string_map, parse_cookies, ThreadSafe> cookies;
+};
+
+std::vector<std::string> make_requests(std::size_t n)
+{
+    std::mt19937 gen(7);
+    std::vector<std::string> out;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        std::string r = "GET /api/v1/items/" + std::to_string(gen() % 10000)
+            + "?page=" + std::to_string(gen() % 50) + "&limit=25&sort=name&filter=active HTTP/1.1\n";
+        r += "Host: example.com\nUser-Agent: bench/1.0\nAccept: application/json\n"
+             "Accept-Encoding: gzip, deflate\nAccept-Language: en-US\nConnection: keep-alive\n"
+             "X-Request-Id: " + std::to_string(gen()) + "\nX-Forwarded-For: 10.0.0." + std::to_string(gen() % 255)
+             + "\nCache-Control: no-cache\n";
+        r += "Cookie: session=" + std::to_string(gen()) + "; theme=dark; lang=en; tz=UTC";
+        out.push_back(std::move(r));
+    }
+    return out;
+}
+
+template<typename Request>
+std::size_t handle(const Request &r, bool deep)
+{
+    std::size_t n = r.method.size() + r.path.size();
+    if (deep)
+    {
+        if constexpr (std::is_same<Request, eager_request>::value)
+            n += r.cookies.size() + r.headers.size();
+        else
+            n += r.cookies->size() + r.headers->size();
+    }
+    return n;
+}
+
+template<typename Request>
+double parse(const std::vector<std::string> &requests, unsigned read_percent)
+{
+    return bench::ns_per_op([&](std::size_t n)
+    {
+        std::size_t acc = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const std::string &raw = requests[i % requests.size()];
+            Request r(raw);
+            acc += handle(r, i % 100 < read_percent);
+        }
+        bench::do_not_optimize(acc);
+    });
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    const auto requests = make_requests(1024);
+    for (unsigned read_percent : {0u, 5u, 100u})
+    {
+        const std::string op = "parse_read" + std::to_string(read_percent);
+        out.report<eager_request>("lazy", "eager", "request", op, parse<eager_request>(requests, read_percent));
+        out.report<lazy_request<false>>("lazy", "lazy", "request", op, parse<lazy_request<false>>(requests, read_percent));
+        out.report<lazy_request<true>>("lazy", "sync", "request", op, parse<lazy_request<true>>(requests, read_percent));
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+// 5 stage monadic chain against the same pipeline written with hand
+// rolled branches. Both pipelines live in noinline functions, so besides
+// timing them their bodies can be compared directly with
+// objdump -d --no-show-raw-insn bench_monadic | c++filt
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t elements = 1 << 16;
+
+pd::optional<int> non_negative(int v)
+{
+    return v >= 0 ? pd::optional<int>(v) : pd::nullopt;
+}
+
+pd::optional<int> below_limit(int v)
+{
+    return v < (1 << 20) ? pd::optional<int>(v) : pd::nullopt;
+}
+
+__attribute__((noinline)) pd::optional<long> chain(const pd::optional<int> &in)
+{
+    return in.and_then(non_negative)
+             .transform([](int v) { return v * 3; })
+             .and_then(below_limit)
+             .transform([](int v) { return v + 1; })
+             .transform([](int v) { return static_cast<long>(v) << 4; });
+}
+
+__attribute__((noinline)) pd::optional<long> branches(const pd::optional<int> &in)
+{
+    if (!in.has_value())
+        return pd::nullopt;
+    int v = *in;
+    if (v < 0)
+        return pd::nullopt;
+    v *= 3;
+    if (v >= (1 << 20))
+        return pd::nullopt;
+    v += 1;
+    return static_cast<long>(v) << 4;
+}
+
+template<typename F>
+double ns_per_element(const std::vector<pd::optional<int>> &input, F &&f)
+{
+    return bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            long acc = 0;
+            for (const auto &o : input)
+                acc += f(o).value_or(0);
+            bench::do_not_optimize(acc);
+        }
+    }) / elements;
+}
+
+void run(bench::reporter &out, double fill)
+{
+    std::mt19937 gen(42);
+    std::bernoulli_distribution engaged(fill);
+    std::uniform_int_distribution<int> value(-(1 << 10), 1 << 19);
+    std::vector<pd::optional<int>> input;
+    input.reserve(elements);
+    for (std::size_t i = 0; i < elements; ++i)
+        input.push_back(engaged(gen) ? pd::optional<int>(value(gen)) : pd::nullopt);
+
+    const std::string op = "pipeline5_fill" + std::to_string(static_cast<int>(fill * 100));
+    out.report<pd::optional<long>>("monadic", "chain", "int", op, ns_per_element(input, chain));
+    out.report<pd::optional<long>>("monadic", "branches", "int", op, ns_per_element(input, branches));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    for (double fill : {0.5, 0.95})
+        run(out, fill);
+    return 0;
+}
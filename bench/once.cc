@@ -0,0 +1,98 @@
+// read side cost of lazily initialized values once they are initialized:
+// pd::once_optional against std::call_once plus std::optional and against
+// function local static. ns/op is wall time per read across all threads
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/pd/once_optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+using table = std::vector<int>;
+
+table make_table()
+{
+    return table(256, 1);
+}
+
+struct once_cell
+{
+    const table& get()
+    {
+        return cell_.get_or_init(make_table);
+    }
+
+    pd::once_optional<table> cell_;
+};
+
+struct call_once_cell
+{
+    const table& get()
+    {
+        std::call_once(flag_, [this] { value_.emplace(make_table()); });
+        return *value_;
+    }
+
+    std::once_flag flag_;
+    std::optional<table> value_;
+};
+
+struct static_cell
+{
+    const table& get()
+    {
+        static const table value = make_table();
+        return value;
+    }
+};
+
+template<typename Cell>
+double read(Cell &cell, unsigned threads)
+{
+    cell.get();
+    return bench::ns_per_op([&](std::size_t n)
+    {
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t)
+            pool.emplace_back([&cell, n]
+            {
+                std::size_t acc = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    bench::do_not_optimize(cell);
+                    acc += cell.get()[i & 255];
+                }
+                bench::do_not_optimize(acc);
+            });
+        for (auto &th : pool)
+            th.join();
+    }) / threads;
+}
+
+template<typename Cell>
+void run(bench::reporter &out, const char *impl, unsigned threads)
+{
+    Cell cell;
+    out.report<Cell>("once", impl, "vector<int>", "read_t" + std::to_string(threads), read(cell, threads));
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= std::max(cores, 4u); threads *= 2)
+    {
+        run<once_cell>(out, "pd", threads);
+        run<call_once_cell>(out, "call_once", threads);
+        run<static_cell>(out, "static", threads);
+    }
+    return 0;
+}
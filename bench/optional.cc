@@ -0,0 +1,254 @@
+// pd::optional against std::optional: lifecycle operations, value_or and
+// comparisons over trivial, heap owning and large types
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+struct large_pod
+{
+    std::array<std::uint64_t, 32> data;
+
+    friend bool operator==(const large_pod &lhs, const large_pod &rhs)
+    {
+        return lhs.data == rhs.data;
+    }
+
+    friend bool operator!=(const large_pod &lhs, const large_pod &rhs)
+    {
+        return lhs.data != rhs.data;
+    }
+
+    friend bool operator<(const large_pod &lhs, const large_pod &rhs)
+    {
+        return lhs.data < rhs.data;
+    }
+};
+
+template<typename T>
+struct sample;
+
+template<>
+struct sample<int>
+{
+    static constexpr const char *name = "int";
+    static int make(int seed) { return seed; }
+};
+
+template<>
+struct sample<double>
+{
+    static constexpr const char *name = "double";
+    static double make(int seed) { return seed * 0.5; }
+};
+
+template<>
+struct sample<std::string>
+{
+    static constexpr const char *name = "string";
+    static std::string make(int seed) { return std::string(48, static_cast<char>('a' + seed % 26)); }
+};
+
+template<>
+struct sample<std::vector<int>>
+{
+    static constexpr const char *name = "vector<int>";
+    static std::vector<int> make(int seed) { return std::vector<int>(16, seed); }
+};
+
+template<>
+struct sample<large_pod>
+{
+    static constexpr const char *name = "large_pod";
+    static large_pod make(int seed)
+    {
+        large_pod p;
+        p.data.fill(static_cast<std::uint64_t>(seed));
+        return p;
+    }
+};
+
+template<template<typename> class Opt, typename T>
+void run(bench::reporter &out, const char *impl)
+{
+    using opt = Opt<T>;
+    const char *type = sample<T>::name;
+    const T a = sample<T>::make(1);
+    const T b = sample<T>::make(2);
+
+    auto report = [&](const char *op, double ns)
+    {
+        out.report<opt>("optional", impl, type, op, ns);
+    };
+
+    report("construct_empty", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            opt o;
+            bench::do_not_optimize(o);
+        }
+    }));
+
+    report("construct_value", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            opt o(a);
+            bench::do_not_optimize(o);
+        }
+    }));
+
+    report("copy_construct", bench::ns_per_op([&](std::size_t n)
+    {
+        opt src(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(src);
+            opt o(src);
+            bench::do_not_optimize(o);
+        }
+    }));
+
+    // move construct out of x and move assign back
+    report("move_roundtrip", bench::ns_per_op([&](std::size_t n)
+    {
+        opt x(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            opt o(std::move(x));
+            bench::do_not_optimize(o);
+            x = std::move(o);
+        }
+        bench::do_not_optimize(x);
+    }));
+
+    report("copy_assign_engaged", bench::ns_per_op([&](std::size_t n)
+    {
+        opt src(b);
+        opt dst(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(src);
+            dst = src;
+            bench::do_not_optimize(dst);
+        }
+    }));
+
+    report("copy_assign_empty", bench::ns_per_op([&](std::size_t n)
+    {
+        opt src(b);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            opt dst;
+            bench::do_not_optimize(src);
+            dst = src;
+            bench::do_not_optimize(dst);
+        }
+    }));
+
+    report("assign_value", bench::ns_per_op([&](std::size_t n)
+    {
+        opt dst(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            dst = b;
+            bench::do_not_optimize(dst);
+        }
+    }));
+
+    report("emplace", bench::ns_per_op([&](std::size_t n)
+    {
+        opt dst(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            dst.emplace(b);
+            bench::do_not_optimize(dst);
+        }
+    }));
+
+    report("reset_emplace", bench::ns_per_op([&](std::size_t n)
+    {
+        opt dst(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            dst.reset();
+            bench::do_not_optimize(dst);
+            dst.emplace(b);
+            bench::do_not_optimize(dst);
+        }
+    }));
+
+    report("value_or_engaged", bench::ns_per_op([&](std::size_t n)
+    {
+        opt o(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(o);
+            T t = o.value_or(b);
+            bench::do_not_optimize(t);
+        }
+    }));
+
+    report("value_or_empty", bench::ns_per_op([&](std::size_t n)
+    {
+        opt o;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(o);
+            T t = o.value_or(b);
+            bench::do_not_optimize(t);
+        }
+    }));
+
+    report("compare_eq", bench::ns_per_op([&](std::size_t n)
+    {
+        opt x(a), y(a);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(x);
+            bench::do_not_optimize(y);
+            bool r = x == y;
+            bench::do_not_optimize(r);
+        }
+    }));
+
+    report("compare_lt", bench::ns_per_op([&](std::size_t n)
+    {
+        opt x(a), y(b);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            bench::do_not_optimize(x);
+            bench::do_not_optimize(y);
+            bool r = x < y;
+            bench::do_not_optimize(r);
+        }
+    }));
+}
+
+template<typename T>
+void run_both(bench::reporter &out)
+{
+    run<pd::optional, T>(out, "pd");
+    run<std::optional, T>(out, "std");
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    run_both<int>(out);
+    run_both<double>(out);
+    run_both<std::string>(out);
+    run_both<std::vector<int>>(out);
+    run_both<large_pod>(out);
+    return 0;
+}
@@ -0,0 +1,173 @@
+// csv ingestion of an optional numeric column: istringstream and std::stod
+// with exceptions wrapped into pd::optional, pd::parse_optional per field
+// after std::string_view splitting, and pd::parse_field batch at each
+// simd level. ns/op is per record
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/optional_vector.hh"
+#include "../include/pd/parse_optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t records = 1 << 18;
+
+const char* level_name(pd::simd_level level)
+{
+    switch (level)
+    {
+    case pd::simd_level::scalar: return "scalar";
+    case pd::simd_level::sse2: return "sse2";
+    case pd::simd_level::avx2: return "avx2";
+    case pd::simd_level::avx512: return "avx512";
+    }
+    return "?";
+}
+
+// id,price,qty with one price in five NULL or empty
+std::string make_csv()
+{
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> price(0.01, 10000.0);
+    std::string csv;
+    for (std::size_t i = 0; i < records; ++i)
+    {
+        csv += std::to_string(i);
+        csv += ',';
+        switch (gen() % 10)
+        {
+        case 0: csv += "NULL"; break;
+        case 1: break;
+        default: csv += std::to_string(price(gen)); break;
+        }
+        csv += ',';
+        csv += std::to_string(gen() % 100);
+        csv += '\n';
+    }
+    return csv;
+}
+
+// field 1 of every line, as a line oriented reader would see it
+template<typename F>
+void for_each_price(const std::string &csv, F &&f)
+{
+    std::string_view rest(csv);
+    while (!rest.empty())
+    {
+        std::size_t eol = rest.find('\n');
+        if (eol == std::string_view::npos)
+            eol = rest.size();
+        const std::string_view line = rest.substr(0, eol);
+        const std::size_t a = line.find(',');
+        const std::size_t b = line.find(',', a + 1);
+        f(line.substr(a + 1, b - a - 1));
+        rest.remove_prefix(std::min(eol + 1, rest.size()));
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    const std::string csv = make_csv();
+    const char *type = "double";
+
+    out.report<pd::optional<double>>("parse", "istringstream", type, "csv_field", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::vector<pd::optional<double>> column;
+            column.reserve(records);
+            for_each_price(csv, [&](std::string_view field)
+            {
+                std::istringstream in{std::string(field)};
+                double d;
+                if (in >> d)
+                    column.push_back(d);
+                else
+                    column.push_back(pd::nullopt);
+            });
+            bench::do_not_optimize(column);
+        }
+    }) / records);
+
+    out.report<pd::optional<double>>("parse", "stod", type, "csv_field", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::vector<pd::optional<double>> column;
+            column.reserve(records);
+            for_each_price(csv, [&](std::string_view field)
+            {
+                try
+                {
+                    column.push_back(std::stod(std::string(field)));
+                }
+                catch (const std::exception&)
+                {
+                    column.push_back(pd::nullopt);
+                }
+            });
+            bench::do_not_optimize(column);
+        }
+    }) / records);
+
+    out.report<pd::optional<double>>("parse", "parse_optional", type, "csv_field", bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            pd::optional_vector<double> column;
+            column.reserve(records);
+            for_each_price(csv, [&](std::string_view field)
+            {
+                column.push_back(pd::parse_optional<double>(field));
+            });
+            bench::do_not_optimize(column);
+        }
+    }) / records);
+
+    const pd::simd_level levels[] = {pd::simd_level::scalar, pd::simd_level::sse2,
+                                     pd::simd_level::avx2, pd::simd_level::avx512};
+    for (pd::simd_level level : levels)
+    {
+        if (level > pd::active_simd_level())
+            continue;
+        out.report<pd::optional<double>>("parse", level_name(level), type, "csv_field", bench::ns_per_op([&](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                pd::optional_vector<double> column;
+                column.reserve(records);
+                pd::parse_field(csv, 1, ',', '\n', column, pd::default_parse_options(), level);
+                bench::do_not_optimize(column);
+            }
+        }) / records);
+    }
+
+    // integer column alone, where splitting is a larger share of the work
+    std::string ints;
+    for (std::size_t i = 0; i < records; ++i)
+        ints += i % 8 ? std::to_string(i * 7919 % 100000) + "\n" : "\n";
+    for (pd::simd_level level : levels)
+    {
+        if (level > pd::active_simd_level())
+            continue;
+        out.report<pd::optional<int>>("parse", level_name(level), "int32", "column", bench::ns_per_op([&](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                pd::optional_vector<int> column;
+                column.reserve(records);
+                pd::parse_column(ints, '\n', column, pd::default_parse_options(), level);
+                bench::do_not_optimize(column);
+            }
+        }) / records);
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// reset and emplace cycles as parse loop does them, pd::recycling_optional
+// against pd::optional and std::optional: each cycle fills token vector
+// with 64 entries or assigns 48 character string, then resets. Global
+// operator new is counted, so beside ns/op per cycle allocations per
+// cycle are reported, measured after few warm up cycles
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/recycling_optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+std::size_t allocations = 0;
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+
+struct Token
+{
+    std::uint32_t offset;
+    std::uint32_t length;
+    int kind;
+};
+
+template<typename Opt, typename Fill>
+void run(bench::reporter &out, const char *impl, const char *type, const char *op, Fill &&fill)
+{
+    Opt opt;
+    auto cycles = [&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            fill(opt);
+            bench::do_not_optimize(opt);
+            opt.reset();
+        }
+    };
+    cycles(16);
+    const std::size_t before = allocations;
+    constexpr std::size_t counted = 1000;
+    cycles(counted);
+    const double per_cycle = static_cast<double>(allocations - before) / counted;
+    out.report<Opt>("recycle", impl, type, op, bench::ns_per_op(cycles));
+    out.report_allocations("recycle", impl, type, op, per_cycle);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    auto tokens = [](auto &opt)
+    {
+        auto &v = opt.emplace();
+        for (std::uint32_t k = 0; k < 64; ++k)
+            v.push_back(Token{k * 8, 8, static_cast<int>(k & 3)});
+    };
+    auto text = [](auto &opt)
+    {
+        opt = "field value long enough to live on the heap, 48";
+    };
+
+    run<std::optional<std::vector<Token>>>(out, "std", "vector<Token>", "reset_emplace", tokens);
+    run<pd::optional<std::vector<Token>>>(out, "pd", "vector<Token>", "reset_emplace", tokens);
+    run<pd::recycling_optional<std::vector<Token>>>(out, "pd", "vector<Token>", "recycling", tokens);
+    run<std::optional<std::string>>(out, "std", "string", "reset_assign", text);
+    run<pd::optional<std::string>>(out, "pd", "string", "reset_assign", text);
+    run<pd::recycling_optional<std::string>>(out, "pd", "string", "recycling", text);
+    return 0;
+}
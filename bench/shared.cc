@@ -0,0 +1,63 @@
+// one config snapshot, 1000 strings, fanned out to 32 threads which
+// all copy it from the same source at once and read it: deep copying
+// std::optional and pd::optional against pd::shared_optional and
+// std::shared_ptr<const T>, which share one block. ns/op is per copy
+// summed over all threads, so it is inverse of throughput
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/shared_optional.hh"
+#include "bench.hh"
+
+namespace
+{
+
+using config = std::vector<std::string>;
+
+constexpr std::size_t threads = 32;
+
+template<typename Holder>
+void run(bench::reporter &out, const char *impl, const Holder &source)
+{
+    const double ns = bench::ns_per_op([&](std::size_t n)
+    {
+        std::vector<std::thread> workers;
+        workers.reserve(threads);
+        for (std::size_t t = 0; t < threads; ++t)
+            workers.emplace_back([&source, n]
+            {
+                std::size_t seen = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    Holder local = source;
+                    if (local)
+                        seen += local->back().size();
+                    bench::do_not_optimize(local);
+                }
+                bench::do_not_optimize(seen);
+            });
+        for (auto &w : workers)
+            w.join();
+    });
+    out.report<Holder>("shared", impl, "config", "fanout32", ns / threads);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    config snapshot;
+    for (int i = 0; i < 1000; ++i)
+        snapshot.push_back("setting." + std::to_string(i) + " = value long enough for heap");
+
+    run(out, "std", std::optional<config>(snapshot));
+    run(out, "pd", pd::optional<config>(snapshot));
+    run(out, "pd", pd::shared_optional<config>(snapshot));
+    run(out, "std", std::shared_ptr<const config>(std::make_shared<config>(snapshot)));
+    return 0;
+}
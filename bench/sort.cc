@@ -0,0 +1,84 @@
+// std::sort over std::vector<pd::optional<T>> against std::optional<T>,
+// one element in ten empty. Sorting swaps through argument dependent
+// lookup, so this is where member swap shows. For arithmetic T also
+// pd::sort_optionals radix sort against std::sort and std::stable_sort.
+// Each round sorts a fresh copy of shuffled input, copy time is
+// measured alone and subtracted. ns/op is per element
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/sort_optionals.hh"
+#include "bench.hh"
+
+namespace
+{
+
+template<typename Opt, typename Make, typename Sort>
+void run(bench::reporter &out, const char *impl, const char *type, const char *op,
+         std::size_t elements, Make &&make, Sort &&sort)
+{
+    std::mt19937 gen(29);
+    std::vector<Opt> source;
+    source.reserve(elements);
+    for (std::size_t i = 0; i < elements; ++i)
+        if (gen() % 10 == 0)
+            source.emplace_back();
+        else
+            source.emplace_back(make(gen()));
+
+    std::vector<Opt> work;
+    const double copy = bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            work = source;
+            bench::do_not_optimize(work);
+        }
+    });
+    const double copy_sort = bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            work = source;
+            sort(work.begin(), work.end());
+            bench::do_not_optimize(work);
+        }
+    });
+    out.report<Opt>("sort", impl, type, op, (copy_sort - copy) / elements);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    auto std_sort = [](auto first, auto last) { std::sort(first, last); };
+    auto std_stable_sort = [](auto first, auto last) { std::stable_sort(first, last); };
+    auto radix_sort = [](auto first, auto last) { pd::sort_optionals(first, last); };
+    auto radix_stable_sort = [](auto first, auto last) { pd::stable_sort_optionals(first, last); };
+    auto int32 = [](std::uint32_t r) { return static_cast<std::int32_t>(r); };
+    auto int64 = [](std::uint32_t r) { return static_cast<std::int64_t>(r) * 2654435761 - (std::int64_t(1) << 40); };
+    auto real = [](std::uint32_t r) { return (static_cast<double>(r) - 2147483648.0) * 0.5; };
+    auto str = [](std::uint32_t r) { return "key" + std::to_string(r % 1000000) + "-padding-to-heap"; };
+    constexpr std::size_t numbers = 1 << 20;
+
+    run<std::optional<std::int32_t>>(out, "std", "int32", "std_sort", numbers, int32, std_sort);
+    run<pd::optional<std::int32_t>>(out, "pd", "int32", "std_sort", numbers, int32, std_sort);
+    run<pd::optional<std::int32_t>>(out, "pd", "int32", "sort_optionals", numbers, int32, radix_sort);
+    run<std::optional<std::int64_t>>(out, "std", "int64", "std_sort", numbers, int64, std_sort);
+    run<pd::optional<std::int64_t>>(out, "pd", "int64", "std_sort", numbers, int64, std_sort);
+    run<pd::optional<std::int64_t>>(out, "pd", "int64", "std_stable_sort", numbers, int64, std_stable_sort);
+    run<pd::optional<std::int64_t>>(out, "pd", "int64", "sort_optionals", numbers, int64, radix_sort);
+    run<pd::optional<std::int64_t>>(out, "pd", "int64", "stable_sort_opt", numbers, int64, radix_stable_sort);
+    run<std::optional<double>>(out, "std", "double", "std_sort", numbers, real, std_sort);
+    run<pd::optional<double>>(out, "pd", "double", "std_sort", numbers, real, std_sort);
+    run<pd::optional<double>>(out, "pd", "double", "std_stable_sort", numbers, real, std_stable_sort);
+    run<pd::optional<double>>(out, "pd", "double", "sort_optionals", numbers, real, radix_sort);
+    run<std::optional<std::string>>(out, "std", "string", "std_sort", 1 << 18, str, std_sort);
+    run<pd::optional<std::string>>(out, "pd", "string", "std_sort", 1 << 18, str, std_sort);
+    return 0;
+}
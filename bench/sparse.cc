@@ -0,0 +1,85 @@
+// pd::sparse_optional_array against dense std::vector<pd::optional<T>>
+// at several fill rates: heap footprint, random lookup and iteration
+// over engaged entries. ns/op is per lookup or per entry of the array
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+#include "../include/pd/sparse_optional_array.hh"
+#include "bench.hh"
+
+namespace
+{
+
+constexpr std::size_t entries = 1 << 22;
+constexpr std::size_t lookups = 1 << 16;
+
+void run(bench::reporter &out, double fill)
+{
+    std::mt19937_64 gen(11);
+    std::bernoulli_distribution engaged(fill);
+    std::vector<pd::optional<std::uint32_t>> dense(entries);
+    for (std::size_t i = 0; i < entries; ++i)
+        if (engaged(gen))
+            dense[i] = static_cast<std::uint32_t>(gen());
+    pd::sparse_optional_array<std::uint32_t> sparse(dense.begin(), dense.end());
+    sparse.shrink_to_fit();
+
+    std::vector<std::size_t> indexes(lookups);
+    for (auto &i : indexes)
+        i = gen() % entries;
+
+    const std::string suffix = "_fill" + std::to_string(fill * 100).substr(0, 4);
+    const char *type = "uint32";
+    out.report_memory("sparse", "dense", type, "memory" + suffix, dense.capacity() * sizeof(dense[0]));
+    out.report_memory("sparse", "sparse", type, "memory" + suffix, sparse.memory_bytes());
+
+    auto lookup = [&](const auto &array)
+    {
+        return bench::ns_per_op([&](std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                std::uint64_t acc = 0;
+                for (std::size_t index : indexes)
+                    acc += array[index].value_or(0);
+                bench::do_not_optimize(acc);
+            }
+        }) / lookups;
+    };
+    out.report<pd::optional<std::uint32_t>>("sparse", "dense", type, "lookup" + suffix, lookup(dense));
+    out.report<pd::sparse_optional_array<std::uint32_t>>("sparse", "sparse", type, "lookup" + suffix, lookup(sparse));
+
+    out.report<pd::optional<std::uint32_t>>("sparse", "dense", type, "iterate" + suffix, bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::uint64_t acc = 0;
+            for (std::size_t j = 0; j < dense.size(); ++j)
+                if (dense[j])
+                    acc += *dense[j] ^ j;
+            bench::do_not_optimize(acc);
+        }
+    }) / entries);
+    out.report<pd::sparse_optional_array<std::uint32_t>>("sparse", "sparse", type, "iterate" + suffix, bench::ns_per_op([&](std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::uint64_t acc = 0;
+            for (auto [index, value] : sparse)
+                acc += value ^ index;
+            bench::do_not_optimize(acc);
+        }
+    }) / entries);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    bench::reporter out(argc, argv);
+    for (double fill : {0.001, 0.01, 0.1, 0.5})
+        run(out, fill);
+    return 0;
+}
@@ -0,0 +1,405 @@
+#ifndef PD_OPTIONAL_ALLOCATOR_OPTIONAL_HH_
+#define PD_OPTIONAL_ALLOCATOR_OPTIONAL_HH_
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+#include <tuple>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+template<typename T, typename Alloc>
+struct allocator_optional;
+
+namespace detail
+{
+
+// U which single argument constructors and assignment take as value
+template<typename Self, typename U>
+struct allocator_optional_argument_;
+
+template<typename T, typename Alloc, typename U>
+struct allocator_optional_argument_<allocator_optional<T, Alloc>, U> : std::integral_constant<bool,
+    std::is_constructible<T, U>::value &&
+    !std::is_same<std::decay_t<U>, allocator_optional<T, Alloc>>::value &&
+    !std::is_same<std::decay_t<U>, pd::in_place_t>::value &&
+    !std::is_same<std::decay_t<U>, nullopt_t>::value &&
+    !std::is_same<std::decay_t<U>, std::allocator_arg_t>::value> {};
+
+} // namespace detail
+
+// allocator_optional is optional which remembers an allocator, also
+// while empty, and builds every value it holds by uses-allocator
+// construction with it. Plain optional cannot do that: once empty it
+// has nowhere to keep the arena, so copying pmr value into it lands in
+// the default resource. Allocator follows the rules of standard
+// containers: copy construction asks select_on_container_copy_construction,
+// move construction takes the source's, assignment and swap keep the
+// target's unless the allocator propagates. allocator_optional is
+// itself uses-allocator constructible, so pmr containers of it hand
+// their resource down to the values
+template<typename T, typename Alloc>
+struct allocator_optional
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "allocator_optional requires non-cv, non-reference T");
+
+    using value_type = T;
+    using allocator_type = Alloc;
+
+    allocator_optional() = default;
+
+    allocator_optional(nullopt_t) noexcept(noexcept(Alloc())) {}
+
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc) noexcept
+        : alloc_(alloc) {}
+
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, nullopt_t) noexcept
+        : alloc_(alloc) {}
+
+    template<typename... Args, typename = std::enable_if_t<std::is_constructible<T, Args...>::value>>
+    explicit allocator_optional(pd::in_place_t, Args&&... args)
+    {
+        construct_(std::forward<Args>(args)...);
+    }
+
+    template<typename... Args, typename = std::enable_if_t<std::is_constructible<T, Args...>::value>>
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, pd::in_place_t, Args&&... args)
+        : alloc_(alloc)
+    {
+        construct_(std::forward<Args>(args)...);
+    }
+
+    template<typename U = T,
+             typename = std::enable_if_t<detail::allocator_optional_argument_<allocator_optional, U>::value>>
+    allocator_optional(U &&u)
+    {
+        construct_(std::forward<U>(u));
+    }
+
+    template<typename U = T,
+             typename = std::enable_if_t<detail::allocator_optional_argument_<allocator_optional, U>::value>>
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, U &&u)
+        : alloc_(alloc)
+    {
+        construct_(std::forward<U>(u));
+    }
+
+    allocator_optional(const allocator_optional &other)
+        : alloc_(alloc_traits_::select_on_container_copy_construction(other.alloc_))
+    {
+        if (other.has_value())
+            construct_(*other);
+    }
+
+    // value moves with its allocator, which is ours now
+    allocator_optional(allocator_optional &&other) noexcept(std::is_nothrow_move_constructible<T>::value)
+        : alloc_(other.alloc_)
+    {
+        if (other.has_value())
+            cell_.construct(std::move(*other));
+    }
+
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, const allocator_optional &other)
+        : alloc_(alloc)
+    {
+        if (other.has_value())
+            construct_(*other);
+    }
+
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, allocator_optional &&other)
+        : alloc_(alloc)
+    {
+        if (other.has_value())
+            construct_(std::move(*other));
+    }
+
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, const optional<T> &other)
+        : alloc_(alloc)
+    {
+        if (other.has_value())
+            construct_(*other);
+    }
+
+    allocator_optional(std::allocator_arg_t, const Alloc &alloc, optional<T> &&other)
+        : alloc_(alloc)
+    {
+        if (other.has_value())
+            construct_(std::move(*other));
+    }
+
+    allocator_optional& operator= (nullopt_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    allocator_optional& operator= (const allocator_optional &other)
+    {
+        if (this == &other)
+            return *this;
+        if constexpr (alloc_traits_::propagate_on_container_copy_assignment::value)
+        {
+            if (alloc_ != other.alloc_)
+                reset();
+            alloc_ = other.alloc_;
+        }
+        if (!other.has_value())
+            reset();
+        else if (has_value())
+            **this = *other;
+        else
+            construct_(*other);
+        return *this;
+    }
+
+    allocator_optional& operator= (allocator_optional &&other)
+        noexcept(std::is_nothrow_move_assignable<T>::value && std::is_nothrow_move_constructible<T>::value &&
+                 (alloc_traits_::propagate_on_container_move_assignment::value ||
+                  alloc_traits_::is_always_equal::value))
+    {
+        if constexpr (alloc_traits_::propagate_on_container_move_assignment::value)
+        {
+            if (alloc_ != other.alloc_)
+                reset();
+            alloc_ = other.alloc_;
+        }
+        if (!other.has_value())
+            reset();
+        else if (has_value())
+            **this = std::move(*other);
+        else if (alloc_ == other.alloc_)
+            cell_.construct(std::move(*other));
+        else
+            construct_(std::move(*other));
+        return *this;
+    }
+
+    // engaged target is assigned, so T keeps whatever allocator it has
+    template<typename U = T,
+             typename = std::enable_if_t<detail::allocator_optional_argument_<allocator_optional, U>::value &&
+                                         std::is_assignable<T&, U>::value>>
+    allocator_optional& operator= (U &&u)
+    {
+        if (has_value())
+            **this = std::forward<U>(u);
+        else
+            construct_(std::forward<U>(u));
+        return *this;
+    }
+
+    template<typename... Args>
+    T& emplace(Args&&... args)
+    {
+        reset();
+        construct_(std::forward<Args>(args)...);
+        return **this;
+    }
+
+    void reset() noexcept
+    {
+        if (has_value())
+            cell_.hard_reset();
+    }
+
+    // values never cross allocators: with unequal, non propagating
+    // allocators each side gets a copy built with its own
+    void swap(allocator_optional &other)
+    {
+        if (alloc_ == other.alloc_ || alloc_traits_::propagate_on_container_swap::value)
+        {
+            if constexpr (alloc_traits_::propagate_on_container_swap::value)
+            {
+                using std::swap;
+                swap(alloc_, other.alloc_);
+            }
+            if (has_value() && other.has_value())
+            {
+                using std::swap;
+                swap(**this, *other);
+            }
+            else if (has_value())
+            {
+                other.cell_.construct(std::move(**this));
+                cell_.hard_reset();
+            }
+            else if (other.has_value())
+            {
+                cell_.construct(std::move(*other));
+                other.cell_.hard_reset();
+            }
+            return;
+        }
+        allocator_optional tmp(std::allocator_arg, other.alloc_, std::move(*this));
+        *this = std::move(other);
+        other = std::move(tmp);
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return alloc_;
+    }
+
+    bool has_value() const noexcept
+    {
+        return cell_.has_value();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return has_value();
+    }
+
+    T& operator* () & noexcept
+    {
+        return cell_.get();
+    }
+
+    const T& operator* () const & noexcept
+    {
+        return cell_.get();
+    }
+
+    T&& operator* () && noexcept
+    {
+        return std::move(cell_).get();
+    }
+
+    T* operator-> () noexcept
+    {
+        return std::addressof(cell_.get());
+    }
+
+    const T* operator-> () const noexcept
+    {
+        return std::addressof(cell_.get());
+    }
+
+    T& value() &
+    {
+        if (PD_OPTIONAL_LIKELY(has_value()))
+            return **this;
+        detail::throw_bad_optional_access();
+    }
+
+    const T& value() const &
+    {
+        if (PD_OPTIONAL_LIKELY(has_value()))
+            return **this;
+        detail::throw_bad_optional_access();
+    }
+
+    T&& value() &&
+    {
+        if (PD_OPTIONAL_LIKELY(has_value()))
+            return std::move(**this);
+        detail::throw_bad_optional_access();
+    }
+
+    template<typename U>
+    T value_or(U &&default_value) const &
+    {
+        return has_value() ? **this : static_cast<T>(std::forward<U>(default_value));
+    }
+
+    template<typename U>
+    T value_or(U &&default_value) &&
+    {
+        return has_value() ? std::move(**this) : static_cast<T>(std::forward<U>(default_value));
+    }
+
+private:
+    using alloc_traits_ = std::allocator_traits<Alloc>;
+
+    // uses-allocator construction of [allocator.uses.construction]:
+    // allocator goes after allocator_arg or last, or not at all when T
+    // does not use it. C++20 library spells it out, also for pairs
+    template<typename... Args>
+    void construct_(Args&&... args)
+    {
+#if defined(__cpp_lib_make_obj_using_allocator)
+        std::apply([this](auto&&... a) { cell_.construct(std::forward<decltype(a)>(a)...); },
+                   std::uses_allocator_construction_args<T>(alloc_, std::forward<Args>(args)...));
+#else
+        if constexpr (!std::uses_allocator<T, Alloc>::value)
+            cell_.construct(std::forward<Args>(args)...);
+        else if constexpr (std::is_constructible<T, std::allocator_arg_t, const Alloc&, Args...>::value)
+            cell_.construct(std::allocator_arg, alloc_, std::forward<Args>(args)...);
+        else
+        {
+            static_assert(std::is_constructible<T, Args..., const Alloc&>::value,
+                    "T uses allocator but takes it neither after allocator_arg nor last");
+            cell_.construct(std::forward<Args>(args)..., alloc_);
+        }
+#endif
+    }
+
+    detail::optional_operations_<T> cell_;
+    Alloc alloc_ {};
+};
+
+template<typename T, typename Alloc>
+void swap(allocator_optional<T, Alloc> &lhs, allocator_optional<T, Alloc> &rhs)
+{
+    lhs.swap(rhs);
+}
+
+// allocators are not part of the value, as with containers
+template<typename T, typename Alloc>
+bool operator== (const allocator_optional<T, Alloc> &lhs, const allocator_optional<T, Alloc> &rhs)
+{
+    if (lhs.has_value() != rhs.has_value())
+        return false;
+    return !lhs.has_value() || *lhs == *rhs;
+}
+
+template<typename T, typename Alloc>
+bool operator!= (const allocator_optional<T, Alloc> &lhs, const allocator_optional<T, Alloc> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+template<typename T, typename Alloc>
+bool operator== (const allocator_optional<T, Alloc> &lhs, nullopt_t) noexcept
+{
+    return !lhs.has_value();
+}
+
+template<typename T, typename Alloc>
+bool operator!= (const allocator_optional<T, Alloc> &lhs, nullopt_t) noexcept
+{
+    return lhs.has_value();
+}
+
+template<typename T, typename Alloc, typename U,
+         typename = std::enable_if_t<!std::is_same<U, nullopt_t>::value &&
+                                     !std::is_same<U, allocator_optional<T, Alloc>>::value>>
+bool operator== (const allocator_optional<T, Alloc> &lhs, const U &rhs)
+{
+    return lhs.has_value() && *lhs == rhs;
+}
+
+template<typename T, typename Alloc, typename U,
+         typename = std::enable_if_t<!std::is_same<U, nullopt_t>::value &&
+                                     !std::is_same<U, allocator_optional<T, Alloc>>::value>>
+bool operator!= (const allocator_optional<T, Alloc> &lhs, const U &rhs)
+{
+    return !(lhs == rhs);
+}
+
+namespace pmr
+{
+
+// optional whose value lives in given memory_resource, the default
+// resource unless one is passed with allocator_arg or by container
+template<typename T>
+using optional = allocator_optional<T, std::pmr::polymorphic_allocator<std::byte>>;
+
+} // namespace pmr
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_ALLOCATOR_OPTIONAL_HH_
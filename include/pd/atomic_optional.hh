@@ -0,0 +1,404 @@
+#ifndef PD_OPTIONAL_ATOMIC_OPTIONAL_HH_
+#define PD_OPTIONAL_ATOMIC_OPTIONAL_HH_
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#include "optional.hh"
+
+// __builtin_clear_padding zeroes padding bits of a value (GCC 11+).
+// Without it padded T cannot be encoded reliably and is rejected
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_clear_padding)
+#define PD_OPTIONAL_HAS_CLEAR_PADDING 1
+#endif
+#endif
+#ifndef PD_OPTIONAL_HAS_CLEAR_PADDING
+#define PD_OPTIONAL_HAS_CLEAR_PADDING 0
+#endif
+
+namespace pd
+{
+
+namespace detail
+{
+
+// bytes needed to encode optional<T> in a single word: the value itself
+// for sentinel types, value plus engaged byte otherwise
+template<typename T>
+constexpr std::size_t atomic_optional_bytes_ = optional_traits<T>::has_sentinel ? sizeof(T) : sizeof(T) + 1;
+
+// atomic_word_ is atomic storage of an 8 or 16 byte word. The 8 byte
+// one is std::atomic<uint64_t>, the 16 byte one uses cmpxchg16b on
+// x86-64 (every x86-64 CPU but the very first AMD64 parts has it) and
+// a spinlock elsewhere, since std::atomic<__int128> goes through
+// libatomic which takes a lock on most targets anyway
+template<std::size_t Bytes>
+struct atomic_word_;
+
+template<>
+struct atomic_word_<8>
+{
+    using word_type = std::uint64_t;
+
+    static constexpr bool is_always_lock_free = std::atomic<word_type>::is_always_lock_free;
+
+    explicit atomic_word_(word_type w) noexcept
+        : word_(w) {}
+
+    word_type load(std::memory_order order) const noexcept
+    {
+        return word_.load(order);
+    }
+
+    void store(word_type w, std::memory_order order) noexcept
+    {
+        word_.store(w, order);
+    }
+
+    word_type exchange(word_type w, std::memory_order order) noexcept
+    {
+        return word_.exchange(w, order);
+    }
+
+    bool compare_exchange_strong(word_type &expected, word_type desired,
+                                 std::memory_order success, std::memory_order failure) noexcept
+    {
+        return word_.compare_exchange_strong(expected, desired, success, failure);
+    }
+
+    bool compare_exchange_weak(word_type &expected, word_type desired,
+                               std::memory_order success, std::memory_order failure) noexcept
+    {
+        return word_.compare_exchange_weak(expected, desired, success, failure);
+    }
+
+private:
+    std::atomic<word_type> word_;
+};
+
+#if defined(__x86_64__) && defined(__GNUC__)
+
+// every operation is a locked cmpxchg16b, which is a full barrier, so
+// memory orders are accepted for interface compatibility only
+template<>
+struct atomic_word_<16>
+{
+    using word_type = unsigned __int128;
+
+    static constexpr bool is_always_lock_free = true;
+
+    explicit atomic_word_(word_type w) noexcept
+        : word_(w) {}
+
+    // cmpxchg16b always writes, comparing against zero and storing zero
+    // back reads current value without changing it
+    word_type load(std::memory_order) const noexcept
+    {
+        word_type expected = 0;
+        cas(expected, 0);
+        return expected;
+    }
+
+    void store(word_type w, std::memory_order order) noexcept
+    {
+        exchange(w, order);
+    }
+
+    word_type exchange(word_type w, std::memory_order) noexcept
+    {
+        // first attempt only fetches current value unless it is zero
+        word_type expected = 0;
+        while (!cas(expected, w)) {}
+        return expected;
+    }
+
+    bool compare_exchange_strong(word_type &expected, word_type desired,
+                                 std::memory_order, std::memory_order) noexcept
+    {
+        return cas(expected, desired);
+    }
+
+    bool compare_exchange_weak(word_type &expected, word_type desired,
+                               std::memory_order, std::memory_order) noexcept
+    {
+        return cas(expected, desired);
+    }
+
+private:
+    bool cas(word_type &expected, word_type desired) const noexcept
+    {
+        std::uint64_t lo = static_cast<std::uint64_t>(expected);
+        std::uint64_t hi = static_cast<std::uint64_t>(expected >> 64);
+        bool ok;
+        asm volatile("lock cmpxchg16b %1"
+                     : "=@ccz"(ok), "+m"(word_), "+a"(lo), "+d"(hi)
+                     : "b"(static_cast<std::uint64_t>(desired)),
+                       "c"(static_cast<std::uint64_t>(desired >> 64))
+                     : "memory");
+        expected = (static_cast<word_type>(hi) << 64) | lo;
+        return ok;
+    }
+
+    alignas(16) mutable word_type word_;
+};
+
+#else
+
+template<>
+struct atomic_word_<16>
+{
+    struct word_type
+    {
+        std::uint64_t lo;
+        std::uint64_t hi;
+
+        friend bool operator==(const word_type &lhs, const word_type &rhs)
+        {
+            return lhs.lo == rhs.lo && lhs.hi == rhs.hi;
+        }
+    };
+
+    static constexpr bool is_always_lock_free = false;
+
+    explicit atomic_word_(word_type w) noexcept
+        : word_(w) {}
+
+    word_type load(std::memory_order) const noexcept
+    {
+        lock_guard_ guard(lock_);
+        return word_;
+    }
+
+    void store(word_type w, std::memory_order) noexcept
+    {
+        lock_guard_ guard(lock_);
+        word_ = w;
+    }
+
+    word_type exchange(word_type w, std::memory_order) noexcept
+    {
+        lock_guard_ guard(lock_);
+        word_type previous = word_;
+        word_ = w;
+        return previous;
+    }
+
+    bool compare_exchange_strong(word_type &expected, word_type desired,
+                                 std::memory_order, std::memory_order) noexcept
+    {
+        lock_guard_ guard(lock_);
+        if (word_ == expected)
+        {
+            word_ = desired;
+            return true;
+        }
+        expected = word_;
+        return false;
+    }
+
+    bool compare_exchange_weak(word_type &expected, word_type desired,
+                               std::memory_order success, std::memory_order failure) noexcept
+    {
+        return compare_exchange_strong(expected, desired, success, failure);
+    }
+
+private:
+    struct lock_guard_
+    {
+        explicit lock_guard_(std::atomic_flag &flag) noexcept
+            : flag_(flag)
+        {
+            while (flag_.test_and_set(std::memory_order_acquire)) {}
+        }
+
+        ~lock_guard_()
+        {
+            flag_.clear(std::memory_order_release);
+        }
+
+        std::atomic_flag &flag_;
+    };
+
+    mutable std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+    word_type word_;
+};
+
+#endif
+
+} // namespace detail
+
+// atomic_optional packs engaged flag and value of small trivially copyable
+// T into one 8 or 16 byte word, so every operation is a single atomic
+// instruction instead of mutex round trip. Sentinel types (see
+// optional_traits) need no flag byte, which lets 8 and 16 byte values
+// with a niche use the smaller word or fit at all.
+// Values are compared bytewise by compare_exchange, padding bits are
+// cleared before encoding so they never cause spurious failures. Where
+// the compiler cannot clear padding, T must have none
+template<typename T>
+struct atomic_optional
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+            "atomic_optional requires trivially copyable T");
+    static_assert(PD_OPTIONAL_HAS_CLEAR_PADDING || std::is_scalar<T>::value ||
+                  std::has_unique_object_representations<T>::value,
+            "atomic_optional requires T without padding bits on this compiler");
+    static_assert(detail::atomic_optional_bytes_<T> <= 16,
+            "atomic_optional requires T of at most 15 bytes, or 16 with a sentinel");
+
+private:
+    using word_storage = detail::atomic_word_<detail::atomic_optional_bytes_<T> <= 8 ? 8 : 16>;
+    using word_type = typename word_storage::word_type;
+    using traits = optional_traits<T>;
+
+public:
+    using value_type = T;
+
+    static constexpr bool is_always_lock_free = word_storage::is_always_lock_free;
+
+    atomic_optional() noexcept
+        : word_(encode(nullopt)) {}
+
+    atomic_optional(pd::nullopt_t) noexcept
+        : word_(encode(nullopt)) {}
+
+    atomic_optional(const T &value) noexcept
+        : word_(encode(optional<T>(value))) {}
+
+    atomic_optional(const optional<T> &value) noexcept
+        : word_(encode(value)) {}
+
+    atomic_optional(const atomic_optional&) = delete;
+    atomic_optional& operator= (const atomic_optional&) = delete;
+
+    bool is_lock_free() const noexcept
+    {
+        return is_always_lock_free;
+    }
+
+    optional<T> load(std::memory_order order = std::memory_order_seq_cst) const noexcept
+    {
+        return decode(word_.load(order));
+    }
+
+    bool has_value(std::memory_order order = std::memory_order_seq_cst) const noexcept
+    {
+        return load(order).has_value();
+    }
+
+    void store(const optional<T> &value, std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        word_.store(encode(value), order);
+    }
+
+    optional<T> exchange(const optional<T> &value, std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        return decode(word_.exchange(encode(value), order));
+    }
+
+    // on failure expected is updated to current value
+    bool compare_exchange_strong(optional<T> &expected, const optional<T> &desired,
+                                 std::memory_order success, std::memory_order failure) noexcept
+    {
+        word_type w = encode(expected);
+        if (word_.compare_exchange_strong(w, encode(desired), success, failure))
+            return true;
+        expected = decode(w);
+        return false;
+    }
+
+    bool compare_exchange_strong(optional<T> &expected, const optional<T> &desired,
+                                 std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        return compare_exchange_strong(expected, desired, order, failure_order(order));
+    }
+
+    bool compare_exchange_weak(optional<T> &expected, const optional<T> &desired,
+                               std::memory_order success, std::memory_order failure) noexcept
+    {
+        word_type w = encode(expected);
+        if (word_.compare_exchange_weak(w, encode(desired), success, failure))
+            return true;
+        expected = decode(w);
+        return false;
+    }
+
+    bool compare_exchange_weak(optional<T> &expected, const optional<T> &desired,
+                               std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        return compare_exchange_weak(expected, desired, order, failure_order(order));
+    }
+
+    // take moves value out leaving atomic_optional empty
+    optional<T> take(std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        return exchange(nullopt, order);
+    }
+
+    // emplace_if_empty stores value only if there is none,
+    // returns whether it was stored
+    bool emplace_if_empty(const T &value, std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        word_type expected = encode(nullopt);
+        return word_.compare_exchange_strong(expected, encode(optional<T>(value)), order, failure_order(order));
+    }
+
+private:
+    static constexpr std::memory_order failure_order(std::memory_order order) noexcept
+    {
+        return order == std::memory_order_acq_rel ? std::memory_order_acquire
+             : order == std::memory_order_release ? std::memory_order_relaxed
+             : order;
+    }
+
+    static void clear_padding(T &value) noexcept
+    {
+#if PD_OPTIONAL_HAS_CLEAR_PADDING
+        __builtin_clear_padding(&value);
+#endif
+        (void)value;
+    }
+
+    static word_type encode(const optional<T> &o) noexcept
+    {
+        word_type w{};
+        if constexpr (traits::has_sentinel)
+        {
+            T value = o.has_value() ? *o : traits::empty_value();
+            clear_padding(value);
+            std::memcpy(&w, &value, sizeof(T));
+        }
+        else if (o.has_value())
+        {
+            T value = *o;
+            clear_padding(value);
+            std::memcpy(&w, &value, sizeof(T));
+            reinterpret_cast<unsigned char*>(&w)[sizeof(T)] = 1;
+        }
+        return w;
+    }
+
+    static optional<T> decode(const word_type &w) noexcept
+    {
+        if constexpr (!traits::has_sentinel)
+            if (!reinterpret_cast<const unsigned char*>(&w)[sizeof(T)])
+                return nullopt;
+        // T is not required to be default constructible
+        union
+        {
+            unsigned char dummy_;
+            T value;
+        } u{};
+        std::memcpy(&u.value, &w, sizeof(T));
+        return optional<T>(u.value);
+    }
+
+    word_storage word_;
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_ATOMIC_OPTIONAL_HH_
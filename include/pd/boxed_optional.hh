@@ -0,0 +1,647 @@
+#ifndef PD_OPTIONAL_BOXED_OPTIONAL_HH_
+#define PD_OPTIONAL_BOXED_OPTIONAL_HH_
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+template<typename T>
+struct boxed_optional;
+
+namespace detail
+{
+
+// free list pool of blocks of one size and alignment, types of the same
+// shape share it. Every thread keeps private list, so allocation and
+// release are a pop and a push. Blocks move between threads in batches
+// through shared list under mutex: thread which runs out takes batch,
+// thread which holds two batches gives one back, exiting thread gives
+// back all. Blocks come from slabs of one batch which are never freed,
+// pool stays at high water mark of engaged boxes.
+// Private list is trivially destructible and flushed by a separate guard,
+// so boxes destroyed after thread teardown (statics, thread_locals engaged
+// before first use of the pool) still find it and go to shared list
+template<std::size_t Size, std::size_t Align>
+struct box_pool_
+{
+    union block
+    {
+        block *next;
+        alignas(Align) unsigned char bytes[Size];
+    };
+
+    // about 16KiB worth of blocks, at least four
+    static constexpr std::size_t batch = std::max<std::size_t>(4, (std::size_t(16) << 10) / sizeof(block));
+
+    static void* allocate()
+    {
+        cache &c = cache_;
+        if (PD_OPTIONAL_LIKELY(c.head != nullptr))
+        {
+            block *b = c.head;
+            c.head = b->next;
+            --c.count;
+            return b;
+        }
+        return refill_(c);
+    }
+
+    static void deallocate(void *p) noexcept
+    {
+        cache &c = cache_;
+        block *b = static_cast<block*>(p);
+        if (c.state != live)
+            return deallocate_cold_(c, b);
+        b->next = c.head;
+        c.head = b;
+        if (++c.count >= 2 * batch)
+            give_back_(c, batch);
+    }
+
+private:
+    enum : unsigned char { fresh, live, retired };
+
+    struct cache
+    {
+        block *head;
+        std::size_t count;
+        unsigned char state;
+    };
+    static_assert(std::is_trivially_destructible<cache>::value, "cache must outlive thread teardown");
+
+    struct cache_guard
+    {
+        ~cache_guard()
+        {
+            cache &c = cache_;
+            give_back_(c, c.count);
+            c.state = retired;
+        }
+    };
+
+    struct shared_list
+    {
+        std::mutex mutex;
+        block *head = nullptr;
+    };
+
+    // leaked on purpose, threads may still exit after static destruction
+    static shared_list& shared_()
+    {
+        static shared_list *s = new shared_list;
+        return *s;
+    }
+
+    static void give_back_(cache &c, std::size_t n) noexcept
+    {
+        if (n == 0)
+            return;
+        block *first = c.head;
+        block *last = first;
+        for (std::size_t i = 1; i < n; ++i)
+            last = last->next;
+        c.head = last->next;
+        c.count -= n;
+        shared_list &s = shared_();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        last->next = s.head;
+        s.head = first;
+    }
+
+    // first use of private list on this thread registers its flush
+    static void attach_(cache &c) noexcept
+    {
+        static thread_local cache_guard guard;
+        (void)guard;
+        c.state = live;
+    }
+
+    PD_OPTIONAL_COLD static void deallocate_cold_(cache &c, block *b) noexcept
+    {
+        if (c.state == fresh)
+        {
+            attach_(c);
+            return deallocate(b);
+        }
+        shared_list &s = shared_();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        b->next = s.head;
+        s.head = b;
+    }
+
+    PD_OPTIONAL_COLD static void* refill_(cache &c)
+    {
+        if (c.state == fresh)
+            attach_(c);
+        {
+            shared_list &s = shared_();
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (c.state == retired && s.head)
+            {
+                block *b = s.head;
+                s.head = b->next;
+                return b;
+            }
+            while (s.head && c.count < batch)
+            {
+                block *b = s.head;
+                s.head = b->next;
+                b->next = c.head;
+                c.head = b;
+                ++c.count;
+            }
+        }
+        if (!c.head)
+        {
+            void *bytes = ::operator new(batch * sizeof(block), std::align_val_t(alignof(block)));
+            block *slab = static_cast<block*>(bytes);
+            for (std::size_t i = 0; i < batch; ++i)
+                slab[i].next = i + 1 < batch ? &slab[i + 1] : nullptr;
+            c.head = slab;
+            c.count = batch;
+        }
+        block *b = c.head;
+        c.head = b->next;
+        --c.count;
+        // nothing would flush blocks kept after teardown
+        if (c.state == retired)
+            give_back_(c, c.count);
+        return b;
+    }
+
+    static thread_local cache cache_;
+};
+
+template<std::size_t Size, std::size_t Align>
+thread_local typename box_pool_<Size, Align>::cache box_pool_<Size, Align>::cache_ {};
+
+template<typename T>
+using box_pool_of_ = box_pool_<sizeof(T), alignof(T)>;
+
+template<typename T>
+struct is_boxed_optional_ : std::false_type {};
+
+template<typename T>
+struct is_boxed_optional_<boxed_optional<T>> : std::true_type {};
+
+// U which single argument constructors and assignment take as value
+template<typename T, typename U>
+struct boxed_argument_ : std::integral_constant<bool,
+    std::is_constructible<T, U>::value &&
+    !std::is_same<std::decay_t<U>, boxed_optional<T>>::value &&
+    !std::is_same<std::decay_t<U>, pd::in_place_t>::value &&
+    !std::is_same<std::decay_t<U>, nullopt_t>::value> {};
+
+} // namespace detail
+
+// boxed_optional is optional of pointer size which keeps its value out
+// of line, in block of per shape pool taken only while engaged. Meant
+// for large T which is mostly empty: holder pays one pointer instead of
+// sizeof(T), access pays one indirection. Interface follows optional,
+// except that move steals the box, so moved from boxed_optional is empty
+// and moves and swap never touch T
+template<typename T>
+struct boxed_optional
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "boxed_optional requires non-cv, non-reference T");
+    static_assert(!std::is_same<T, in_place_t>::value && !std::is_same<T, nullopt_t>::value,
+            "instatiation with in_place_t or nullopt_t is ill-formed");
+
+    using value_type = T;
+
+    constexpr boxed_optional() noexcept = default;
+
+    constexpr boxed_optional(nullopt_t) noexcept {}
+
+    template<typename... Args, typename = std::enable_if_t<std::is_constructible<T, Args...>::value>>
+    explicit boxed_optional(pd::in_place_t, Args&&... args)
+    {
+        construct_(std::forward<Args>(args)...);
+    }
+
+    template<typename I, typename... Args,
+             typename = std::enable_if_t<std::is_constructible<T, std::initializer_list<I>&, Args...>::value>>
+    explicit boxed_optional(pd::in_place_t, std::initializer_list<I> ilist, Args&&... args)
+    {
+        construct_(ilist, std::forward<Args>(args)...);
+    }
+
+    template<typename U = T,
+             std::enable_if_t<std::is_convertible<U&&, T>::value> * = nullptr,
+             std::enable_if_t<detail::boxed_argument_<T, U>::value> * = nullptr>
+    boxed_optional(U &&u)
+    {
+        construct_(std::forward<U>(u));
+    }
+
+    template<typename U = T,
+             std::enable_if_t<!std::is_convertible<U&&, T>::value> * = nullptr,
+             std::enable_if_t<detail::boxed_argument_<T, U>::value> * = nullptr>
+    explicit boxed_optional(U &&u)
+    {
+        construct_(std::forward<U>(u));
+    }
+
+    boxed_optional(const boxed_optional &other)
+    {
+        if (other.ptr_)
+            construct_(*other.ptr_);
+    }
+
+    boxed_optional(boxed_optional &&other) noexcept
+        : ptr_(other.ptr_)
+    {
+        other.ptr_ = nullptr;
+    }
+
+    boxed_optional(const optional<T> &other)
+    {
+        if (other.has_value())
+            construct_(*other);
+    }
+
+    boxed_optional(optional<T> &&other)
+    {
+        if (other.has_value())
+            construct_(*std::move(other));
+    }
+
+    ~boxed_optional()
+    {
+        reset();
+    }
+
+    boxed_optional& operator= (nullopt_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    boxed_optional& operator= (const boxed_optional &other)
+    {
+        if (!other.ptr_)
+            reset();
+        else if (ptr_)
+            *ptr_ = *other.ptr_;
+        else
+            construct_(*other.ptr_);
+        return *this;
+    }
+
+    boxed_optional& operator= (boxed_optional &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            ptr_ = other.ptr_;
+            other.ptr_ = nullptr;
+        }
+        return *this;
+    }
+
+    template<typename U = T,
+             std::enable_if_t<detail::boxed_argument_<T, U>::value && std::is_assignable<T&, U>::value> * = nullptr>
+    boxed_optional& operator= (U &&u)
+    {
+        if (ptr_)
+            *ptr_ = std::forward<U>(u);
+        else
+            construct_(std::forward<U>(u));
+        return *this;
+    }
+
+    template<typename... Args>
+    T& emplace(Args&&... args)
+    {
+        static_assert(std::is_constructible<T, Args...>::value,
+                "T must be constructible with Args\n");
+        reset();
+        construct_(std::forward<Args>(args)...);
+        return *ptr_;
+    }
+
+    template<typename U, typename... Args>
+    T& emplace(std::initializer_list<U> ilist, Args&&... args)
+    {
+        static_assert(std::is_constructible<T, std::initializer_list<U>&, Args...>::value,
+                "T must be constructible with initializer_list and Args\n");
+        reset();
+        construct_(ilist, std::forward<Args>(args)...);
+        return *ptr_;
+    }
+
+    void reset() noexcept
+    {
+        if (ptr_)
+        {
+            ptr_->~T();
+            detail::box_pool_of_<T>::deallocate(ptr_);
+            ptr_ = nullptr;
+        }
+    }
+
+    void swap(boxed_optional &other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+    }
+
+    bool has_value() const noexcept
+    {
+        return ptr_ != nullptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ptr_ != nullptr;
+    }
+
+    const T* operator-> () const
+    {
+        return ptr_;
+    }
+
+    T* operator-> ()
+    {
+        return ptr_;
+    }
+
+    const T& operator* () const &
+    {
+        return *ptr_;
+    }
+
+    T& operator* () &
+    {
+        return *ptr_;
+    }
+
+    const T&& operator* () const &&
+    {
+        return std::move(*ptr_);
+    }
+
+    T&& operator* () &&
+    {
+        return std::move(*ptr_);
+    }
+
+    T& value() &
+    {
+        if (PD_OPTIONAL_LIKELY(ptr_ != nullptr))
+            return *ptr_;
+        detail::throw_bad_optional_access();
+    }
+
+    const T& value() const &
+    {
+        if (PD_OPTIONAL_LIKELY(ptr_ != nullptr))
+            return *ptr_;
+        detail::throw_bad_optional_access();
+    }
+
+    T&& value() &&
+    {
+        if (PD_OPTIONAL_LIKELY(ptr_ != nullptr))
+            return std::move(*ptr_);
+        detail::throw_bad_optional_access();
+    }
+
+    const T&& value() const &&
+    {
+        if (PD_OPTIONAL_LIKELY(ptr_ != nullptr))
+            return std::move(*ptr_);
+        detail::throw_bad_optional_access();
+    }
+
+    template<typename U>
+    T value_or(U &&u) const &
+    {
+        return ptr_ ? *ptr_ : static_cast<T>(std::forward<U>(u));
+    }
+
+    template<typename U>
+    T value_or(U &&u) &&
+    {
+        return ptr_ ? std::move(*ptr_) : static_cast<T>(std::forward<U>(u));
+    }
+
+    // value_or_else invokes f only when there is no value
+    template<typename F>
+    T value_or_else(F &&f) const &
+    {
+        return ptr_ ? *ptr_ : static_cast<T>(std::invoke(std::forward<F>(f)));
+    }
+
+    template<typename F>
+    T value_or_else(F &&f) &&
+    {
+        return ptr_ ? std::move(*ptr_) : static_cast<T>(std::invoke(std::forward<F>(f)));
+    }
+
+    // and_then returns f(value) which must be optional, or empty one
+    template<typename F>
+    auto and_then(F &&f) &
+    {
+        return and_then_(*this, std::forward<F>(f));
+    }
+
+    template<typename F>
+    auto and_then(F &&f) const &
+    {
+        return and_then_(*this, std::forward<F>(f));
+    }
+
+    template<typename F>
+    auto and_then(F &&f) &&
+    {
+        return and_then_(std::move(*this), std::forward<F>(f));
+    }
+
+    // transform returns boxed_optional holding f(value), built right
+    // in its box
+    template<typename F>
+    auto transform(F &&f) &
+    {
+        return transform_(*this, std::forward<F>(f));
+    }
+
+    template<typename F>
+    auto transform(F &&f) const &
+    {
+        return transform_(*this, std::forward<F>(f));
+    }
+
+    template<typename F>
+    auto transform(F &&f) &&
+    {
+        return transform_(std::move(*this), std::forward<F>(f));
+    }
+
+    // or_else returns copy of *this when engaged, f() otherwise
+    template<typename F>
+    boxed_optional or_else(F &&f) const &
+    {
+        static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F>>>,
+                      boxed_optional>::value, "or_else callable must return boxed_optional<T>\n");
+        return ptr_ ? *this : std::invoke(std::forward<F>(f));
+    }
+
+    template<typename F>
+    boxed_optional or_else(F &&f) &&
+    {
+        static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F>>>,
+                      boxed_optional>::value, "or_else callable must return boxed_optional<T>\n");
+        return ptr_ ? std::move(*this) : std::invoke(std::forward<F>(f));
+    }
+
+private:
+    template<typename U>
+    friend struct boxed_optional;
+
+    // block goes back to pool if constructor of T throws
+    template<typename... Args>
+    void construct_(Args&&... args)
+    {
+        struct release_
+        {
+            ~release_()
+            {
+                if (block)
+                    detail::box_pool_of_<T>::deallocate(block);
+            }
+            void *block;
+        } release {detail::box_pool_of_<T>::allocate()};
+        ptr_ = ::new (release.block) T(std::forward<Args>(args)...);
+        release.block = nullptr;
+    }
+
+    // Self carries value category, value is dereferenced only when there is one
+    template<typename Self, typename F>
+    static auto and_then_(Self &&self, F &&f)
+    {
+        using U = detail::and_then_result_<F, decltype(*std::declval<Self>())>;
+        static_assert(detail::is_optional_<U>::value || detail::is_boxed_optional_<U>::value,
+                "and_then callable must return pd::optional or pd::boxed_optional\n");
+        if (self.ptr_)
+            return std::invoke(std::forward<F>(f), *std::forward<Self>(self));
+        return U(nullopt);
+    }
+
+    template<typename Self, typename F>
+    static auto transform_(Self &&self, F &&f)
+    {
+        using U = detail::transform_result_<F, decltype(*std::declval<Self>())>;
+        detail::check_transform_result_<U>();
+        boxed_optional<U> result;
+        if (self.ptr_)
+            result.construct_(std::invoke(std::forward<F>(f), *std::forward<Self>(self)));
+        return result;
+    }
+
+    T *ptr_ = nullptr;
+};
+
+template<typename T>
+void swap(boxed_optional<T> &lhs, boxed_optional<T> &rhs) noexcept
+{
+    lhs.swap(rhs);
+}
+
+template<typename T, typename U>
+bool operator== (const boxed_optional<T> &lhs, const boxed_optional<U> &rhs)
+{
+    return lhs.has_value() == rhs.has_value() && (!lhs.has_value() || *lhs == *rhs);
+}
+
+template<typename T, typename U>
+bool operator!= (const boxed_optional<T> &lhs, const boxed_optional<U> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+template<typename T, typename U>
+bool operator< (const boxed_optional<T> &lhs, const boxed_optional<U> &rhs)
+{
+    return rhs.has_value() && (!lhs.has_value() || *lhs < *rhs);
+}
+
+template<typename T, typename U>
+bool operator> (const boxed_optional<T> &lhs, const boxed_optional<U> &rhs)
+{
+    return rhs < lhs;
+}
+
+template<typename T, typename U>
+bool operator<= (const boxed_optional<T> &lhs, const boxed_optional<U> &rhs)
+{
+    return !(rhs < lhs);
+}
+
+template<typename T, typename U>
+bool operator>= (const boxed_optional<T> &lhs, const boxed_optional<U> &rhs)
+{
+    return !(lhs < rhs);
+}
+
+template<typename T>
+bool operator== (const boxed_optional<T> &lhs, nullopt_t) noexcept
+{
+    return !lhs.has_value();
+}
+
+template<typename T>
+bool operator== (nullopt_t, const boxed_optional<T> &rhs) noexcept
+{
+    return !rhs.has_value();
+}
+
+template<typename T>
+bool operator!= (const boxed_optional<T> &lhs, nullopt_t) noexcept
+{
+    return lhs.has_value();
+}
+
+template<typename T>
+bool operator!= (nullopt_t, const boxed_optional<T> &rhs) noexcept
+{
+    return rhs.has_value();
+}
+
+template<typename T, typename U, std::enable_if_t<!detail::is_boxed_optional_<U>::value &&
+                                                        !detail::is_optional_<U>::value> * = nullptr>
+bool operator== (const boxed_optional<T> &lhs, const U &rhs)
+{
+    return lhs.has_value() && *lhs == rhs;
+}
+
+template<typename T, typename U, std::enable_if_t<!detail::is_boxed_optional_<U>::value &&
+                                                        !detail::is_optional_<U>::value> * = nullptr>
+bool operator== (const U &lhs, const boxed_optional<T> &rhs)
+{
+    return rhs.has_value() && lhs == *rhs;
+}
+
+template<typename T, typename U, std::enable_if_t<!detail::is_boxed_optional_<U>::value &&
+                                                        !detail::is_optional_<U>::value> * = nullptr>
+bool operator!= (const boxed_optional<T> &lhs, const U &rhs)
+{
+    return !(lhs == rhs);
+}
+
+template<typename T, typename U, std::enable_if_t<!detail::is_boxed_optional_<U>::value &&
+                                                        !detail::is_optional_<U>::value> * = nullptr>
+bool operator!= (const U &lhs, const boxed_optional<T> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_BOXED_OPTIONAL_HH_
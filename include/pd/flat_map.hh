@@ -0,0 +1,379 @@
+#ifndef PD_OPTIONAL_FLAT_MAP_HH_
+#define PD_OPTIONAL_FLAT_MAP_HH_
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+// flat_map is an open addressing hash map whose buckets are one
+// contiguous array of optional<std::pair<K, V>>, empty optional marks
+// empty slot, so there is no separate control array. Collisions are
+// resolved by linear probing, erase shifts following entries of the
+// cluster back instead of leaving tombstones, so lookups never walk over
+// deleted slots and the table does not degrade under churn.
+// Capacity is a power of two, load factor stays at or below 3/4.
+// Inserting may rehash and invalidates iterators and references, erase
+// invalidates those to entries after erased one in its cluster.
+// Key of stored pair must not be modified through iterator
+template<typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+struct flat_map
+{
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using size_type = std::size_t;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    template<bool Const>
+    struct basic_iterator
+    {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = flat_map::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        basic_iterator() noexcept = default;
+
+        // iterator converts to const_iterator
+        template<bool C = Const, std::enable_if_t<C> * = nullptr>
+        basic_iterator(const basic_iterator<false> &other) noexcept
+            : slot_(other.slot_), end_(other.end_) {}
+
+        reference operator*() const noexcept
+        {
+            return **slot_;
+        }
+
+        pointer operator->() const noexcept
+        {
+            return &**slot_;
+        }
+
+        basic_iterator& operator++() noexcept
+        {
+            ++slot_;
+            skip();
+            return *this;
+        }
+
+        basic_iterator operator++(int) noexcept
+        {
+            basic_iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator==(const basic_iterator &lhs, const basic_iterator &rhs) noexcept
+        {
+            return lhs.slot_ == rhs.slot_;
+        }
+
+        friend bool operator!=(const basic_iterator &lhs, const basic_iterator &rhs) noexcept
+        {
+            return lhs.slot_ != rhs.slot_;
+        }
+
+    private:
+        friend struct flat_map;
+        friend struct basic_iterator<true>;
+
+        using slot_ptr = std::conditional_t<Const, const optional<value_type>*, optional<value_type>*>;
+
+        basic_iterator(slot_ptr slot, slot_ptr end) noexcept
+            : slot_(slot), end_(end) {}
+
+        void skip() noexcept
+        {
+            while (slot_ != end_ && !slot_->has_value())
+                ++slot_;
+        }
+
+        slot_ptr slot_ = nullptr;
+        slot_ptr end_ = nullptr;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    flat_map() = default;
+
+    explicit flat_map(size_type bucket_count, const Hash &hash = Hash(), const KeyEqual &equal = KeyEqual())
+        : hash_(hash), equal_(equal)
+    {
+        rehash(bucket_count);
+    }
+
+    flat_map(std::initializer_list<value_type> ilist)
+    {
+        reserve(ilist.size());
+        for (const value_type &v : ilist)
+            insert(v);
+    }
+
+    size_type size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    size_type bucket_count() const noexcept
+    {
+        return slots_.size();
+    }
+
+    float load_factor() const noexcept
+    {
+        return slots_.empty() ? 0.0f : static_cast<float>(size_) / static_cast<float>(slots_.size());
+    }
+
+    iterator begin() noexcept
+    {
+        iterator it(slots_.data(), slots_.data() + slots_.size());
+        it.skip();
+        return it;
+    }
+
+    iterator end() noexcept
+    {
+        return iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size());
+    }
+
+    const_iterator begin() const noexcept
+    {
+        const_iterator it(slots_.data(), slots_.data() + slots_.size());
+        it.skip();
+        return it;
+    }
+
+    const_iterator end() const noexcept
+    {
+        return const_iterator(slots_.data() + slots_.size(), slots_.data() + slots_.size());
+    }
+
+    iterator find(const K &key)
+    {
+        const size_type i = find_slot(key);
+        return i == npos ? end() : at_slot(i);
+    }
+
+    const_iterator find(const K &key) const
+    {
+        const size_type i = find_slot(key);
+        return i == npos ? end() : const_iterator(slots_.data() + i, slots_.data() + slots_.size());
+    }
+
+    bool contains(const K &key) const
+    {
+        return find_slot(key) != npos;
+    }
+
+    size_type count(const K &key) const
+    {
+        return contains(key);
+    }
+
+    V& at(const K &key)
+    {
+        const size_type i = find_slot(key);
+        if (i == npos)
+            throw std::out_of_range("pd::flat_map::at: key not found");
+        return slots_[i]->second;
+    }
+
+    const V& at(const K &key) const
+    {
+        const size_type i = find_slot(key);
+        if (i == npos)
+            throw std::out_of_range("pd::flat_map::at: key not found");
+        return slots_[i]->second;
+    }
+
+    V& operator[](const K &key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    V& operator[](K &&key)
+    {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    // constructs V from args only when key is absent. Present key is
+    // found before any growth, so it never rehashes
+    template<typename Key, typename... Args>
+    std::pair<iterator, bool> try_emplace(Key &&key, Args&&... args)
+    {
+        size_type i = npos;
+        if (!slots_.empty())
+            for (i = home(key); slots_[i].has_value(); i = next(i))
+                if (equal_(slots_[i]->first, key))
+                    return {at_slot(i), false};
+        if (grow_for_one())
+            for (i = home(key); slots_[i].has_value(); i = next(i)) {}
+        slots_[i].emplace(std::piecewise_construct, std::forward_as_tuple(std::forward<Key>(key)),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+        ++size_;
+        return {at_slot(i), true};
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(const K &key, Args&&... args)
+    {
+        return try_emplace(key, std::forward<Args>(args)...);
+    }
+
+    std::pair<iterator, bool> insert(const value_type &v)
+    {
+        return try_emplace(v.first, v.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type &&v)
+    {
+        return try_emplace(std::move(v.first), std::move(v.second));
+    }
+
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const K &key, M &&m)
+    {
+        auto r = try_emplace(key, std::forward<M>(m));
+        if (!r.second)
+            r.first->second = std::forward<M>(m);
+        return r;
+    }
+
+    // number of erased entries, 0 or 1
+    size_type erase(const K &key)
+    {
+        const size_type i = find_slot(key);
+        if (i == npos)
+            return 0;
+        erase_slot(i);
+        return 1;
+    }
+
+    void erase(const_iterator pos)
+    {
+        erase_slot(static_cast<size_type>(pos.slot_ - slots_.data()));
+    }
+
+    void clear() noexcept
+    {
+        for (auto &slot : slots_)
+            slot.reset();
+        size_ = 0;
+    }
+
+    // room for n entries without rehash
+    void reserve(size_type n)
+    {
+        rehash(n + (n + 2) / 3);
+    }
+
+    // resizes to power of two of at least n buckets, never below
+    // what current size needs
+    void rehash(size_type n)
+    {
+        n = std::max(n, size_ + (size_ + 2) / 3);
+        size_type cap = min_buckets;
+        while (cap < n)
+            cap *= 2;
+        if (cap == slots_.size())
+            return;
+        std::vector<optional<value_type>> old(cap);
+        old.swap(slots_);
+        shift_ = 64 - static_cast<unsigned>(__builtin_ctzll(cap));
+        for (auto &slot : old)
+            if (slot.has_value())
+            {
+                size_type i = home(slot->first);
+                while (slots_[i].has_value())
+                    i = next(i);
+                slots_[i].emplace(std::move(*slot));
+            }
+    }
+
+private:
+    static constexpr size_type min_buckets = 16;
+    static constexpr size_type npos = static_cast<size_type>(-1);
+
+    // fibonacci hashing, top bits of product spread
+    // even identity hashes of sequential keys
+    size_type home(const K &key) const
+    {
+        return static_cast<size_type>((static_cast<std::uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull) >> shift_);
+    }
+
+    size_type next(size_type i) const noexcept
+    {
+        return (i + 1) & (slots_.size() - 1);
+    }
+
+    iterator at_slot(size_type i) noexcept
+    {
+        return iterator(slots_.data() + i, slots_.data() + slots_.size());
+    }
+
+    size_type find_slot(const K &key) const
+    {
+        if (slots_.empty())
+            return npos;
+        for (size_type i = home(key); slots_[i].has_value(); i = next(i))
+            if (equal_(slots_[i]->first, key))
+                return i;
+        return npos;
+    }
+
+    // true when table was rehashed to make room for one more entry
+    bool grow_for_one()
+    {
+        if (4 * (size_ + 1) <= 3 * slots_.size())
+            return false;
+        rehash(std::max(min_buckets, 2 * slots_.size()));
+        return true;
+    }
+
+    // backward shift: entries after hole move into it unless
+    // their home lies cyclically in (hole, entry]
+    void erase_slot(size_type hole)
+    {
+        const size_type mask = slots_.size() - 1;
+        for (size_type j = next(hole); slots_[j].has_value(); j = next(j))
+        {
+            const size_type h = home(slots_[j]->first);
+            if (((h - hole - 1) & mask) < ((j - hole) & mask))
+                continue;
+            slots_[hole] = std::move(slots_[j]);
+            hole = j;
+        }
+        slots_[hole].reset();
+        --size_;
+    }
+
+    std::vector<optional<value_type>> slots_;
+    size_type size_ = 0;
+    unsigned shift_ = 64;
+    Hash hash_;
+    KeyEqual equal_;
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_FLAT_MAP_HH_
@@ -0,0 +1,137 @@
+#ifndef PD_OPTIONAL_LAZY_HH_
+#define PD_OPTIONAL_LAZY_HH_
+#pragma once
+
+#include "once_optional.hh"
+
+namespace pd
+{
+
+// lazy holds callable and an empty slot for its result. Value is built
+// in place on first access and the callable is destroyed right after,
+// so whatever it captured is released. If the callable throws, lazy
+// stays unevaluated and next access calls it again.
+// With ThreadSafe == false there are no atomics at all and concurrent
+// access is a data race, like for any other object. With ThreadSafe ==
+// true first access may race, the first caller evaluates and others wait;
+// readers then pay one acquire load, same as once_optional
+template<typename T, typename F = T(*)(), bool ThreadSafe = false>
+struct lazy
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "lazy requires non-cv, non-reference T");
+
+    using value_type = T;
+
+    explicit lazy(F f)
+    {
+        new (std::addressof(fn_.fn)) F(std::move(f));
+    }
+
+    // moving is not synchronized, source must not be accessed concurrently
+    lazy(lazy &&other)
+    {
+        if (other.has_value())
+        {
+            new (std::addressof(cell_.value_)) T(std::move(other.cell_.value_));
+            detail::once_store_(cell_.state_, detail::once_ready_);
+        }
+        else
+            new (std::addressof(fn_.fn)) F(std::move(other.fn_.fn));
+    }
+
+    lazy(const lazy&) = delete;
+    lazy& operator= (const lazy&) = delete;
+
+    // value, if any, is destroyed by cell_
+    ~lazy()
+    {
+        if (!has_value())
+            fn_.fn.~F();
+    }
+
+    bool has_value() const noexcept
+    {
+        return detail::once_load_(cell_.state_) == detail::once_ready_;
+    }
+
+    const T& get() const
+    {
+        if (PD_OPTIONAL_LIKELY(has_value()))
+            return cell_.value_;
+        return evaluate();
+    }
+
+    T& get()
+    {
+        return const_cast<T&>(static_cast<const lazy&>(*this).get());
+    }
+
+    const T& operator*() const
+    {
+        return get();
+    }
+
+    T& operator*()
+    {
+        return get();
+    }
+
+    const T* operator->() const
+    {
+        return std::addressof(get());
+    }
+
+    T* operator->()
+    {
+        return std::addressof(get());
+    }
+
+private:
+    using state_type = std::conditional_t<ThreadSafe, std::atomic<unsigned char>, unsigned char>;
+
+    // callable is alive until the value is built, state of cell_ tells which
+    union callable_
+    {
+        callable_() noexcept
+            : dummy_{} {}
+        ~callable_() {}
+
+        struct dummy_t{} dummy_;
+        F fn;
+    };
+
+    PD_OPTIONAL_COLD const T& evaluate() const
+    {
+        detail::once_init_(cell_.state_, [this]
+        {
+            // result of callable is constructed right in the storage
+            new (std::addressof(cell_.value_)) T(std::invoke(std::move(fn_.fn)));
+            fn_.fn.~F();
+        });
+        return cell_.value_;
+    }
+
+    mutable detail::once_cell_<T, state_type> cell_;
+    mutable callable_ fn_;
+};
+
+// lazy which may be first accessed from several threads at once
+template<typename T, typename F = T(*)()>
+using sync_lazy = lazy<T, F, true>;
+
+template<typename F>
+lazy<std::decay_t<std::invoke_result_t<std::decay_t<F>&&>>, std::decay_t<F>> make_lazy(F &&f)
+{
+    return lazy<std::decay_t<std::invoke_result_t<std::decay_t<F>&&>>, std::decay_t<F>>(std::forward<F>(f));
+}
+
+template<typename F>
+sync_lazy<std::decay_t<std::invoke_result_t<std::decay_t<F>&&>>, std::decay_t<F>> make_sync_lazy(F &&f)
+{
+    return sync_lazy<std::decay_t<std::invoke_result_t<std::decay_t<F>&&>>, std::decay_t<F>>(std::forward<F>(f));
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_LAZY_HH_
@@ -0,0 +1,169 @@
+#ifndef PD_OPTIONAL_ONCE_OPTIONAL_HH_
+#define PD_OPTIONAL_ONCE_OPTIONAL_HH_
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+namespace detail
+{
+
+enum : unsigned char { once_empty_, once_running_, once_ready_ };
+
+inline unsigned char once_load_(const std::atomic<unsigned char> &state) noexcept
+{
+    return state.load(std::memory_order_acquire);
+}
+
+inline unsigned char once_load_(unsigned char state) noexcept
+{
+    return state;
+}
+
+inline void once_store_(std::atomic<unsigned char> &state, unsigned char value) noexcept
+{
+    state.store(value, std::memory_order_release);
+}
+
+inline void once_store_(unsigned char &state, unsigned char value) noexcept
+{
+    state = value;
+}
+
+// once_cell_ is room for one T next to the state which alone says
+// whether it is alive, there is no engaged flag of its own. Value is
+// destroyed only once state is ready
+template<typename T, typename State, bool = std::is_trivially_destructible<T>::value>
+struct once_cell_
+{
+    constexpr once_cell_() noexcept
+        : dummy_{} {}
+
+    ~once_cell_()
+    {
+        if (once_load_(state_) == once_ready_)
+            value_.~T();
+    }
+
+    struct dummy_t{};
+    union
+    {
+        dummy_t dummy_;
+        T value_;
+    };
+    State state_ {once_empty_};
+};
+
+template<typename T, typename State>
+struct once_cell_<T, State, true>
+{
+    constexpr once_cell_() noexcept
+        : dummy_{} {}
+
+    struct dummy_t{};
+    union
+    {
+        dummy_t dummy_;
+        T value_;
+    };
+    State state_ {once_empty_};
+};
+
+// once_init_ calls init at most once per state, which is atomic for cells
+// shared between threads and plain unsigned char otherwise. Only the caller
+// which moved state from empty to running calls init, the others wait for
+// it to become ready. If init throws, state goes back to empty and next
+// caller retries
+template<typename State, typename Init>
+PD_OPTIONAL_COLD void once_init_(State &state, Init &&init)
+{
+    if constexpr (std::is_same<State, std::atomic<unsigned char>>::value)
+    {
+        for (unsigned spins = 0;; ++spins)
+        {
+            unsigned char expected = once_empty_;
+            if (state.compare_exchange_strong(expected, once_running_, std::memory_order_acquire))
+                break;
+            if (expected == once_ready_)
+                return;
+            // other thread is running init, it is expensive by assumption
+            // so give up the core after a short spin
+            if (spins >= 64)
+                std::this_thread::yield();
+        }
+    }
+    else
+        state = once_running_;
+
+    struct rollback_
+    {
+        ~rollback_()
+        {
+            if (state)
+                once_store_(*state, once_empty_);
+        }
+        State *state;
+    } rollback {&state};
+
+    init();
+    rollback.state = nullptr;
+    once_store_(state, once_ready_);
+}
+
+} // namespace detail
+
+// once_optional is a cell initialized at most once, safe to race on.
+// Readers do a single acquire load of state_, which sits in the same
+// object right after the storage and is its only engaged flag, so there
+// is no separate once_flag and no indirection.
+// Concurrent initializers wait for the winning one; if its callable
+// throws the cell stays empty and next caller retries
+template<typename T>
+struct once_optional : private detail::once_cell_<T, std::atomic<unsigned char>>
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "once_optional requires non-cv, non-reference T");
+
+    using value_type = T;
+
+    constexpr once_optional() noexcept = default;
+
+    once_optional(const once_optional&) = delete;
+    once_optional& operator= (const once_optional&) = delete;
+
+    bool has_value() const noexcept
+    {
+        return detail::once_load_(this->state_) == detail::once_ready_;
+    }
+
+    // empty until initialization has completed
+    optional<const T&> get() const noexcept
+    {
+        if (has_value())
+            return optional<const T&>(this->value_);
+        return nullopt;
+    }
+
+    // returns stored value, calling f to produce it if there is none yet
+    template<typename F>
+    const T& get_or_init(F &&f)
+    {
+        if (PD_OPTIONAL_LIKELY(has_value()))
+            return this->value_;
+        detail::once_init_(this->state_, [&]
+        {
+            // result of f is constructed right in the storage
+            new (std::addressof(this->value_)) T(std::invoke(std::forward<F>(f)));
+        });
+        return this->value_;
+    }
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_ONCE_OPTIONAL_HH_
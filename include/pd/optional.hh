@@ -5,6 +5,56 @@
 #include <type_traits>
 #include <memory>
 #include <exception>
+#include <utility>
+#include <initializer_list>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <cstdlib>
+
+// PD_OPTIONAL_NO_EXCEPTIONS makes access to empty optional call the
+// installed bad access handler instead of throwing. It is turned on
+// automatically when compiling with -fno-exceptions
+#if !defined(PD_OPTIONAL_NO_EXCEPTIONS) && !defined(__cpp_exceptions)
+#define PD_OPTIONAL_NO_EXCEPTIONS
+#endif
+
+// C++20 constant evaluation can construct and destroy objects
+// (std::construct_at, constexpr destructors), so every operation of
+// optional is constexpr there. C++17 gets the same for trivial types
+#if defined(__cpp_lib_constexpr_dynamic_alloc) && __cpp_constexpr >= 201907L
+#define PD_OPTIONAL_CONSTEXPR_CXX20 constexpr
+#define PD_OPTIONAL_HAS_CONSTRUCT_AT 1
+#else
+#define PD_OPTIONAL_CONSTEXPR_CXX20
+#define PD_OPTIONAL_HAS_CONSTRUCT_AT 0
+#endif
+
+#if defined(__cpp_lib_bit_cast)
+#include <bit>
+#endif
+
+#if defined(__GNUC__)
+#define PD_OPTIONAL_COLD __attribute__((noinline, cold))
+#define PD_OPTIONAL_LIKELY(x) __builtin_expect(!!(x), 1)
+#elif defined(_MSC_VER)
+#define PD_OPTIONAL_COLD __declspec(noinline)
+#define PD_OPTIONAL_LIKELY(x) (x)
+#else
+#define PD_OPTIONAL_COLD
+#define PD_OPTIONAL_LIKELY(x) (x)
+#endif
+
+// PD_OPTIONAL_INSTRUMENT counts lifecycle events of optional<T> per T,
+// see optional_instrument.hh. Without it every hook is an empty
+// statement and generated code is the same as with no hooks at all
+#ifdef PD_OPTIONAL_INSTRUMENT
+#include "optional_instrument.hh"
+#define PD_OPTIONAL_RECORD(T, e) ::pd::instrument::detail::record_<T>(::pd::instrument::event::e)
+#else
+#define PD_OPTIONAL_RECORD(T, e) static_cast<void>(0)
+#endif
 
 namespace pd
 {
@@ -16,14 +66,104 @@ struct in_place_t
 };
 constexpr static in_place_t in_place{};
 
+// optional_traits is a customization point. By default optional<T> keeps
+// a separate engaged flag next to the value. Specialize it for a type which
+// has an invalid bit pattern (nullptr, INT_MIN, NaN payload, enum sentinel)
+// and optional<T> will use that pattern as the empty state instead, so
+// sizeof(optional<T>) == sizeof(T). Storing the sentinel itself in such
+// optional makes it empty. Specialization requires T to be trivially copyable
+// and must provide:
+//     static constexpr bool has_sentinel = true;
+//     static T empty_value() noexcept;
+//     static bool is_empty(const T&) noexcept;
+template<typename T>
+struct optional_traits
+{
+    static constexpr bool has_sentinel = false;
+};
+
+// sentinel_traits marks single value of T as empty one, e.g.
+//     template<> struct pd::optional_traits<Node*> : pd::sentinel_traits<Node*, nullptr> {};
+//     template<> struct pd::optional_traits<Id> : pd::sentinel_traits<Id, Id::invalid> {};
+template<typename T, T Sentinel>
+struct sentinel_traits
+{
+    static constexpr bool has_sentinel = true;
+
+    static constexpr T empty_value() noexcept
+    {
+        return Sentinel;
+    }
+
+    static constexpr bool is_empty(const T &t) noexcept
+    {
+        return t == Sentinel;
+    }
+};
+
+// nan_traits marks one specific quiet NaN payload as empty.
+// Other NaNs (including std::numeric_limits<T>::quiet_NaN()) stay engaged
+template<typename T>
+struct nan_traits
+{
+    static_assert(std::is_floating_point<T>::value && std::numeric_limits<T>::has_quiet_NaN,
+            "nan_traits requires floating point type with quiet NaN");
+    static_assert(sizeof(T) == sizeof(std::uint32_t) || sizeof(T) == sizeof(std::uint64_t),
+            "nan_traits supports only binary32 and binary64");
+
+    using bits_t = std::conditional_t<sizeof(T) == sizeof(std::uint32_t),
+                                      std::uint32_t, std::uint64_t>;
+    static constexpr bits_t empty_bits = sizeof(T) == sizeof(std::uint32_t)
+        ? bits_t(0x7fc0'0a0dU) : bits_t(0x7ff8'0000'0a0d'0a0dULL);
+
+    static constexpr bool has_sentinel = true;
+
+#if defined(__cpp_lib_bit_cast)
+    static constexpr T empty_value() noexcept
+    {
+        return std::bit_cast<T>(empty_bits);
+    }
+
+    static constexpr bool is_empty(const T &t) noexcept
+    {
+        return std::bit_cast<bits_t>(t) == empty_bits;
+    }
+#else
+    static T empty_value() noexcept
+    {
+        T t;
+        std::memcpy(&t, &empty_bits, sizeof(T));
+        return t;
+    }
+
+    static bool is_empty(const T &t) noexcept
+    {
+        bits_t bits;
+        std::memcpy(&bits, &t, sizeof(T));
+        return bits == empty_bits;
+    }
+#endif
+};
+
 namespace detail
 {
 
+// tag for constructing value from result of invoking callable,
+// lets transform() build its result directly in the storage
+struct invoke_tag_t
+{
+    explicit invoke_tag_t() = default;
+};
+
 // optional_storage_ holds actual data and responsible
 // for proper object deletion since union requires it
-// two versions: one for trivial destructible object
-// second for others
-template<typename T, bool = std::is_trivially_destructible<T>::value>
+// three versions: one for trivial destructible object,
+// second for others and third for types with sentinel
+// declared in optional_traits<T>
+// every version exposes engaged(), mark_engaged() and mark_empty()
+// so upper layers never touch the flag directly
+template<typename T, bool = std::is_trivially_destructible<T>::value,
+                     bool = optional_traits<T>::has_sentinel>
 struct optional_storage_
 {
     constexpr optional_storage_() noexcept 
@@ -33,7 +173,11 @@ struct optional_storage_
     constexpr optional_storage_(pd::in_place_t, Args&&... args)
         : value_(std::forward<Args>(args)...), is_set_(true) {}
 
-    ~optional_storage_()
+    template<typename F, typename Arg>
+    constexpr optional_storage_(invoke_tag_t, F &&f, Arg &&arg)
+        : value_(std::invoke(std::forward<F>(f), std::forward<Arg>(arg))), is_set_(true) {}
+
+    PD_OPTIONAL_CONSTEXPR_CXX20 ~optional_storage_()
     {
         if (is_set_)
         {
@@ -42,6 +186,21 @@ struct optional_storage_
         }
     }
 
+    constexpr bool engaged() const noexcept
+    {
+        return is_set_;
+    }
+
+    constexpr void mark_engaged() noexcept
+    {
+        is_set_ = true;
+    }
+
+    constexpr void mark_empty() noexcept
+    {
+        is_set_ = false;
+    }
+
     struct dummy_t{};
     union
     {
@@ -52,7 +211,7 @@ struct optional_storage_
 };
 
 template<typename T>
-struct optional_storage_<T, true>
+struct optional_storage_<T, true, false>
 {
     constexpr optional_storage_() noexcept 
         : dummy_{}, is_set_{false} {}
@@ -61,6 +220,25 @@ struct optional_storage_<T, true>
     constexpr optional_storage_(pd::in_place_t, Args&&... args)
         : value_(std::forward<Args>(args)...), is_set_(true) {}
 
+    template<typename F, typename Arg>
+    constexpr optional_storage_(invoke_tag_t, F &&f, Arg &&arg)
+        : value_(std::invoke(std::forward<F>(f), std::forward<Arg>(arg))), is_set_(true) {}
+
+    constexpr bool engaged() const noexcept
+    {
+        return is_set_;
+    }
+
+    constexpr void mark_engaged() noexcept
+    {
+        is_set_ = true;
+    }
+
+    constexpr void mark_empty() noexcept
+    {
+        is_set_ = false;
+    }
+
     struct dummy_t{};
     union
     {
@@ -70,6 +248,48 @@ struct optional_storage_<T, true>
     bool is_set_;
 };
 
+// value_ is always alive here, empty state is
+// encoded by optional_traits<T>::empty_value()
+template<typename T>
+struct optional_storage_<T, true, true>
+{
+    using traits = optional_traits<T>;
+
+    static_assert(std::is_trivially_copyable<T>::value,
+            "optional_traits<T>::has_sentinel requires trivially copyable T");
+
+    constexpr optional_storage_() noexcept 
+        : value_(traits::empty_value()) {}
+
+    template<typename... Args>
+    constexpr optional_storage_(pd::in_place_t, Args&&... args)
+        : value_(std::forward<Args>(args)...) {}
+
+    template<typename F, typename Arg>
+    constexpr optional_storage_(invoke_tag_t, F &&f, Arg &&arg)
+        : value_(std::invoke(std::forward<F>(f), std::forward<Arg>(arg))) {}
+
+    constexpr bool engaged() const noexcept
+    {
+        return !traits::is_empty(value_);
+    }
+
+    constexpr void mark_engaged() noexcept {}
+
+    constexpr void mark_empty() noexcept
+    {
+        value_ = traits::empty_value();
+    }
+
+    T value_;
+};
+
+template<typename T>
+struct optional_storage_<T, false, true>
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+            "optional_traits<T>::has_sentinel requires trivially copyable T");
+};
 
 // optional_operations_ provides some essential
 // operations to derived templatees
@@ -78,11 +298,13 @@ struct optional_operations_ : optional_storage_<T>
 {
     using optional_storage_<T>::optional_storage_; // pulling constructors
     using optional_storage_<T>::value_;
-    using optional_storage_<T>::is_set_;
+    using optional_storage_<T>::engaged;
+    using optional_storage_<T>::mark_engaged;
+    using optional_storage_<T>::mark_empty;
     
     constexpr bool has_value() const noexcept
     {
-        return is_set_;
+        return engaged();
     }
 
     constexpr T& get() &
@@ -105,31 +327,60 @@ struct optional_operations_ : optional_storage_<T>
         return std::move(value_);
     }
 
+    // trivial destructor has nothing to run, skipping it keeps
+    // reset usable in C++17 constant evaluation
     constexpr void hard_reset()
     {
-        get().~T();
-        is_set_ = false;
+        if constexpr (!std::is_trivially_destructible<T>::value)
+        {
+#if PD_OPTIONAL_HAS_CONSTRUCT_AT
+            std::destroy_at(std::addressof(value_));
+#else
+            get().~T();
+#endif
+        }
+        mark_empty();
     }
 
+    // placement new is never constant, C++20 has std::construct_at for
+    // that. C++17 fallback for trivial storage assigns whole storage
+    // built in place, which constant evaluation accepts and optimizer
+    // turns into the same stores
     template<typename... Args>
     constexpr void construct(Args&&... args) noexcept(noexcept(T(std::forward<Args>(args)...)))
     {
-        new (std::addressof(value_)) T(std::forward<Args>(args)...);
-        is_set_ = true;
+#if PD_OPTIONAL_HAS_CONSTRUCT_AT
+        std::construct_at(std::addressof(value_), std::forward<Args>(args)...);
+        mark_engaged();
+#else
+        if constexpr (std::is_trivially_copy_assignable<optional_storage_<T>>::value &&
+                      std::is_trivially_destructible<T>::value)
+        {
+            static_cast<optional_storage_<T>&>(*this) =
+                optional_storage_<T>(pd::in_place, std::forward<Args>(args)...);
+        }
+        else
+        {
+            new (std::addressof(value_)) T(std::forward<Args>(args)...);
+            mark_engaged();
+        }
+#endif
     }
 
+    // assigns state of other, when both sides are engaged
+    // T::operator= is used so existing object keeps its resources
     template<typename Option>
     constexpr void assign(Option&& other)
     {
-        if (has_value())
-        {
-            if (!other.has_value())
-                hard_reset();
-        }
-        else
+        if (other.has_value())
         {
-            construct(other.get());
+            if (has_value())
+                get() = std::forward<Option>(other).get();
+            else
+                construct(std::forward<Option>(other).get());
         }
+        else if (has_value())
+            hard_reset();
     }
 };
 
@@ -139,13 +390,12 @@ struct optional_copy_ : optional_operations_<T>
 {
     using optional_operations_<T>::optional_operations_;
     using optional_operations_<T>::value_;
-    using optional_operations_<T>::is_set_;
 
     constexpr optional_copy_(const optional_copy_ &other)
         : optional_copy_()
     {
-        if (other->has_value())
-            construct(other.get());
+        if (other.has_value())
+            this->construct(other.get());
     }
 
     constexpr optional_copy_() = default;
@@ -168,12 +418,12 @@ struct optional_move_ : optional_copy_<T>
 {
     using optional_copy_<T>::optional_copy_;
     using optional_copy_<T>::value_;
-    using optional_copy_<T>::is_set_;
 
-    constexpr optional_move_(optional_move_ &&other) noexcept
+    constexpr optional_move_(optional_move_ &&other)
+        noexcept(std::is_nothrow_move_constructible<T>::value)
     {
-        if (other->has_value())
-            construct(std::move(other.get()));
+        if (other.has_value())
+            this->construct(std::move(other.get()));
     }
 
     constexpr optional_move_() = default;
@@ -201,7 +451,7 @@ struct optional_copy_assign_ : optional_move_<T>
     constexpr optional_copy_assign_&
     operator=(const optional_copy_assign_ &other)
     {
-        assign(other);
+        this->assign(other);
         return *this;
     }
 
@@ -228,8 +478,10 @@ struct optional_move_assign_ : optional_copy_assign_<T>
 
     constexpr optional_move_assign_&
     operator= (optional_move_assign_ &&other)
+        noexcept(std::is_nothrow_move_constructible<T>::value &&
+                 std::is_nothrow_move_assignable<T>::value)
     {
-        assign(std::move(other));
+        this->assign(std::move(other));
         return *this;
     }
 
@@ -360,10 +612,120 @@ struct bad_optional_access : public std::exception
     }
 };
 
+// bad_access_handler is called on access to empty optional in
+// PD_OPTIONAL_NO_EXCEPTIONS mode. It must not return, if it does
+// std::abort is called right after it
+using bad_access_handler = void (*)();
+
+namespace detail
+{
+
+inline bad_access_handler bad_access_handler_ = nullptr;
+
+// single out of line copy of the failure path, so value() inlines
+// into callers as a compare and a rarely taken call
+[[noreturn]] PD_OPTIONAL_COLD inline void throw_bad_optional_access()
+{
+#ifdef PD_OPTIONAL_NO_EXCEPTIONS
+    if (bad_access_handler_)
+        bad_access_handler_();
+    std::abort();
+#else
+    throw bad_optional_access();
+#endif
+}
+
+} // namespace detail
+
+// installs handler and returns previous one, nullptr means plain std::abort
+inline bad_access_handler set_bad_access_handler(bad_access_handler handler) noexcept
+{
+    bad_access_handler previous = detail::bad_access_handler_;
+    detail::bad_access_handler_ = handler;
+    return previous;
+}
+
+template<typename T>
+struct optional;
+
+namespace detail
+{
+
+template<typename T>
+struct is_optional_ : std::false_type {};
+
+template<typename T>
+struct is_optional_<optional<T>> : std::true_type {};
+
+// result of and_then callable must be some optional
+template<typename F, typename Arg>
+using and_then_result_ = std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F, Arg>>>;
+
+// result of transform callable becomes value_type of new optional
+template<typename F, typename Arg>
+using transform_result_ = std::remove_cv_t<std::invoke_result_t<F, Arg>>;
+
+template<typename U>
+constexpr void check_transform_result_()
+{
+    static_assert(!std::is_reference<U>::value && !std::is_array<U>::value && !std::is_void<U>::value,
+            "transform callable must return non-array object type");
+    static_assert(!std::is_same<U, in_place_t>::value && !std::is_same<U, nullopt_t>::value,
+            "transform callable must not return in_place_t or nullopt_t");
+}
+
+#ifdef PD_OPTIONAL_INSTRUMENT
+// optional_counter_ counts copies and moves of engaged optional<T> in
+// its own special members, so those of optional stay defaulted and
+// are still deleted exactly when T's are
+template<typename T>
+struct optional_counter_
+{
+    constexpr optional_counter_() noexcept = default;
+
+    constexpr optional_counter_(const optional_counter_ &other) noexcept
+    {
+        if (source_engaged(other))
+            PD_OPTIONAL_RECORD(T, copy_construct);
+    }
+
+    constexpr optional_counter_(optional_counter_ &&other) noexcept
+    {
+        if (source_engaged(other))
+            PD_OPTIONAL_RECORD(T, move_construct);
+    }
+
+    constexpr optional_counter_& operator= (const optional_counter_ &other) noexcept
+    {
+        if (source_engaged(other))
+            PD_OPTIONAL_RECORD(T, copy_assign);
+        return *this;
+    }
+
+    constexpr optional_counter_& operator= (optional_counter_ &&other) noexcept
+    {
+        if (source_engaged(other))
+            PD_OPTIONAL_RECORD(T, move_assign);
+        return *this;
+    }
+
+private:
+    static constexpr bool source_engaged(const optional_counter_ &counter) noexcept
+    {
+        return static_cast<const optional<T>&>(counter).has_value();
+    }
+};
+#endif
+
+} // namespace detail
+
 template<typename T>
 struct optional : private detail::optional_move_assign_<T>,
                   private detail::optional_delete_copy_or_move_<T>,
                   private detail::optional_delete_copy_or_move_assign_<T>
+#ifdef PD_OPTIONAL_INSTRUMENT
+                , private detail::optional_counter_<T>
+#endif
 {
 private:
     using base = detail::optional_move_assign_<T>;
@@ -374,8 +736,18 @@ private:
 public:
     using value_type = T;
 
+#ifdef PD_OPTIONAL_INSTRUMENT
+    constexpr optional() noexcept
+    {
+        PD_OPTIONAL_RECORD(T, default_construct);
+    }
+#else
     constexpr optional() noexcept = default;
-    constexpr optional(pd::nullopt_t) noexcept {}
+#endif
+    constexpr optional(pd::nullopt_t) noexcept
+    {
+        PD_OPTIONAL_RECORD(T, default_construct);
+    }
 
     constexpr optional(const optional&) = default;
     constexpr optional(optional&&) = default;
@@ -386,7 +758,10 @@ public:
     // In place construction
     template<typename... Args>
     constexpr explicit optional(std::enable_if_t<std::is_constructible<T, Args...>::value, pd::in_place_t>,
-            Args&&... args) : base(in_place, std::forward<Args>(args)...) {}
+            Args&&... args) : base(in_place, std::forward<Args>(args)...)
+    {
+        PD_OPTIONAL_RECORD(T, in_place_construct);
+    }
 
     template<typename I, typename... Args>
     constexpr explicit optional(
@@ -394,6 +769,7 @@ public:
             in_place_t>, std::initializer_list<I> ilist, Args&&... args)
     {
         this->construct(ilist, std::forward<Args>(args)...);
+        PD_OPTIONAL_RECORD(T, in_place_construct);
     }
 
     // Contruct stored value with value of type U
@@ -402,32 +778,44 @@ public:
              std::enable_if_t<std::is_constructible<T, U &&>::value &&
                               !std::is_same<std::decay_t<U>, in_place_t>::value &&
                               !std::is_same<optional<T>, std::decay_t<U>>::value> * = nullptr>
-    constexpr optional(U &&u) : base(in_place, std::forward<U>(u)) {}
+    constexpr optional(U &&u) : base(in_place, std::forward<U>(u))
+    {
+        PD_OPTIONAL_RECORD(T, value_construct);
+    }
 
     template<typename U = T,
              std::enable_if_t<!std::is_convertible<U&&, T>::value> * = nullptr,
              std::enable_if_t<std::is_constructible<T, U &&>::value &&
                               !std::is_same<std::decay_t<U>, in_place_t>::value &&
                               !std::is_same<optional<T>, std::decay_t<U>>::value>* = nullptr>
-    constexpr explicit optional(U &&u) : base(in_place, std::forward<U>(u)) {}
+    constexpr explicit optional(U &&u) : base(in_place, std::forward<U>(u))
+    {
+        PD_OPTIONAL_RECORD(T, value_construct);
+    }
 
     // Copy constructor
     template<typename U = T,
-            std::enable_if_t<std::is_constructible<T, U&&>::value &&
+            std::enable_if_t<std::is_constructible<T, const U&>::value &&
                                 std::is_convertible<const U&, T>::value> * = nullptr>
     constexpr optional(const optional<U> &other)
     {
         if (other.has_value())
-            this->construct(other.get());
+        {
+            this->construct(*other);
+            PD_OPTIONAL_RECORD(T, converting_construct);
+        }
     }
 
     template<typename U = T,
-            std::enable_if_t<std::is_constructible<T, U&&>::value &&
+            std::enable_if_t<std::is_constructible<T, const U&>::value &&
                                 !std::is_convertible<const U&, T>::value> * = nullptr>
     constexpr explicit optional(const optional<U> &other)
     {
         if (other.has_value())
-            this->construct(other.get());
+        {
+            this->construct(*other);
+            PD_OPTIONAL_RECORD(T, converting_construct);
+        }
     }
 
     // Move constructor
@@ -437,7 +825,10 @@ public:
     constexpr optional(optional<U> &&other)
     {
         if (other.has_value())
-            this->construct(std::move(other.get()));
+        {
+            this->construct(*std::move(other));
+            PD_OPTIONAL_RECORD(T, converting_construct);
+        }
     }
 
     template<typename U = T,
@@ -446,7 +837,10 @@ public:
     constexpr explicit optional(optional<U> &&other)
     {
         if (other.has_value())
-            this->construct(std::move(other.get()));
+        {
+            this->construct(*std::move(other));
+            PD_OPTIONAL_RECORD(T, converting_construct);
+        }
     }
 
     // Destructor
@@ -457,8 +851,8 @@ public:
     {
         if (this->has_value())
         {
-            this->value_.~T();
-            this->is_set_ = false;
+            PD_OPTIONAL_RECORD(T, reset);
+            this->hard_reset();
         }
         return *this;
     }
@@ -466,6 +860,7 @@ public:
     template<typename U, std::enable_if_t<std::is_constructible<T, U&&>::value && std::is_assignable<T&, U>::value>* = nullptr>
     constexpr optional& operator= (U &&u)
     {
+        PD_OPTIONAL_RECORD(T, value_assign);
         if(this->has_value())
             this->value_ = std::forward<U>(u);
         else
@@ -474,29 +869,35 @@ public:
     }
 
     template<typename U, 
-        std::enable_if_t<std::is_constructible<T, const U&>::value && std::is_assignable<T, const U&>::value> * = nullptr>
+        std::enable_if_t<std::is_constructible<T, const U&>::value && std::is_assignable<T&, const U&>::value> * = nullptr>
     constexpr optional& operator= (const optional<U> &other)
     {
+        PD_OPTIONAL_RECORD(T, value_assign);
         if (other.has_value())
         {
-            this->value_ = other.value_;
-            this->is_set_ = true;
+            if (this->has_value())
+                this->value_ = *other;
+            else
+                this->construct(*other);
         }
-        else
+        else if (this->has_value())
             this->hard_reset();
         return *this;
     }
 
     template<typename U, 
-        std::enable_if_t<std::is_constructible<T, U&&>::value && std::is_assignable<T, U&&>::value> * = nullptr>
+        std::enable_if_t<std::is_constructible<T, U&&>::value && std::is_assignable<T&, U&&>::value> * = nullptr>
     constexpr optional& operator= (optional<U> &&other)
     {
+        PD_OPTIONAL_RECORD(T, value_assign);
         if (other.has_value())
         {
-            this->value_ = std::move(other.value_);
-            this->is_set_ = true;
+            if (this->has_value())
+                this->value_ = *std::move(other);
+            else
+                this->construct(*std::move(other));
         }
-        else
+        else if (this->has_value())
             this->hard_reset();
         return *this;
     }
@@ -531,40 +932,44 @@ public:
 
     constexpr explicit operator bool() const noexcept
     {
-        return this->is_set_;
+        return this->engaged();
     }
 
     constexpr bool has_value() const noexcept
     {
-        return this->is_set_;
+        return this->engaged();
     }
 
     constexpr T& value() &
     {
-        if (this->has_value())
+        if (PD_OPTIONAL_LIKELY(this->has_value()))
             return this->value_;
-        throw bad_optional_access();
+        PD_OPTIONAL_RECORD(T, bad_access);
+        detail::throw_bad_optional_access();
     }
 
     constexpr const T& value() const &
     {
-        if (this->has_value())
+        if (PD_OPTIONAL_LIKELY(this->has_value()))
             return this->value_;
-        throw bad_optional_access();
+        PD_OPTIONAL_RECORD(T, bad_access);
+        detail::throw_bad_optional_access();
     }
 
     constexpr T&& value() &&
     {
-        if (this->has_value())
+        if (PD_OPTIONAL_LIKELY(this->has_value()))
             return std::move(this->value_);
-        throw bad_optional_access();
+        PD_OPTIONAL_RECORD(T, bad_access);
+        detail::throw_bad_optional_access();
     }
 
     constexpr const T&& value() const &&
     {
-        if (this->has_value())
+        if (PD_OPTIONAL_LIKELY(this->has_value()))
             return std::move(this->value_);
-        throw bad_optional_access();
+        PD_OPTIONAL_RECORD(T, bad_access);
+        detail::throw_bad_optional_access();
     }
 
     template<typename U>
@@ -574,48 +979,360 @@ public:
                       std::is_move_constructible<T>::value &&
                       std::is_convertible<U&&, T>::value,
                       "T must be copy/move constructible and convertible from U\n");
-        return this->has_value() ? **this : static_cast<T>(std::forward<U>(u));
+        if (this->has_value())
+        {
+            PD_OPTIONAL_RECORD(T, value_or_copy);
+            return **this;
+        }
+        return static_cast<T>(std::forward<U>(u));
     }
 
-    void reset()
+    // value_or_else invokes f only when there is no value
+    template<typename F>
+    constexpr T value_or_else(F &&f) const &
     {
+        static_assert(std::is_copy_constructible<T>::value &&
+                      std::is_convertible<std::invoke_result_t<F>, T>::value,
+                      "T must be copy constructible and convertible from result of F\n");
         if (this->has_value())
         {
-            this->value_.~T();
-            this->is_set_ = false;
+            PD_OPTIONAL_RECORD(T, value_or_copy);
+            return this->value_;
+        }
+        return static_cast<T>(std::invoke(std::forward<F>(f)));
+    }
+
+    template<typename F>
+    constexpr T value_or_else(F &&f) &&
+    {
+        static_assert(std::is_move_constructible<T>::value &&
+                      std::is_convertible<std::invoke_result_t<F>, T>::value,
+                      "T must be move constructible and convertible from result of F\n");
+        return this->has_value() ? std::move(this->value_) : static_cast<T>(std::invoke(std::forward<F>(f)));
+    }
+
+    // and_then returns f(value) which must be optional, or empty one
+    template<typename F>
+    constexpr auto and_then(F &&f) &
+    {
+        using U = detail::and_then_result_<F, T&>;
+        static_assert(detail::is_optional_<U>::value, "and_then callable must return pd::optional\n");
+        if (this->has_value())
+            return std::invoke(std::forward<F>(f), this->value_);
+        return U(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto and_then(F &&f) const &
+    {
+        using U = detail::and_then_result_<F, const T&>;
+        static_assert(detail::is_optional_<U>::value, "and_then callable must return pd::optional\n");
+        if (this->has_value())
+            return std::invoke(std::forward<F>(f), this->value_);
+        return U(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto and_then(F &&f) &&
+    {
+        using U = detail::and_then_result_<F, T&&>;
+        static_assert(detail::is_optional_<U>::value, "and_then callable must return pd::optional\n");
+        if (this->has_value())
+            return std::invoke(std::forward<F>(f), std::move(this->value_));
+        return U(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto and_then(F &&f) const &&
+    {
+        using U = detail::and_then_result_<F, const T&&>;
+        static_assert(detail::is_optional_<U>::value, "and_then callable must return pd::optional\n");
+        if (this->has_value())
+            return std::invoke(std::forward<F>(f), std::move(this->value_));
+        return U(nullopt);
+    }
+
+    // transform returns optional holding f(value), result of f is
+    // constructed right in the storage of returned optional
+    template<typename F>
+    constexpr auto transform(F &&f) &
+    {
+        using U = detail::transform_result_<F, T&>;
+        detail::check_transform_result_<U>();
+        if (this->has_value())
+            return optional<U>(detail::invoke_tag_t{}, std::forward<F>(f), this->value_);
+        return optional<U>(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto transform(F &&f) const &
+    {
+        using U = detail::transform_result_<F, const T&>;
+        detail::check_transform_result_<U>();
+        if (this->has_value())
+            return optional<U>(detail::invoke_tag_t{}, std::forward<F>(f), this->value_);
+        return optional<U>(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto transform(F &&f) &&
+    {
+        using U = detail::transform_result_<F, T&&>;
+        detail::check_transform_result_<U>();
+        if (this->has_value())
+            return optional<U>(detail::invoke_tag_t{}, std::forward<F>(f), std::move(this->value_));
+        return optional<U>(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto transform(F &&f) const &&
+    {
+        using U = detail::transform_result_<F, const T&&>;
+        detail::check_transform_result_<U>();
+        if (this->has_value())
+            return optional<U>(detail::invoke_tag_t{}, std::forward<F>(f), std::move(this->value_));
+        return optional<U>(nullopt);
+    }
+
+    // or_else returns copy of *this when engaged, f() otherwise
+    template<typename F>
+    constexpr optional or_else(F &&f) const &
+    {
+        static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F>>>,
+                      optional>::value, "or_else callable must return optional<T>\n");
+        return this->has_value() ? *this : std::invoke(std::forward<F>(f));
+    }
+
+    template<typename F>
+    constexpr optional or_else(F &&f) &&
+    {
+        static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F>>>,
+                      optional>::value, "or_else callable must return optional<T>\n");
+        return this->has_value() ? std::move(*this) : std::invoke(std::forward<F>(f));
+    }
+
+    constexpr void reset()
+    {
+        if (this->has_value())
+        {
+            PD_OPTIONAL_RECORD(T, reset);
+            this->hard_reset();
         }
     }
 
     template<typename... Args>
-    T& emplace(Args&&... args)
+    constexpr T& emplace(Args&&... args)
     {
         static_assert(std::is_constructible<T, Args...>::value,
                 "T must be constructible with Args\n");
+        PD_OPTIONAL_RECORD(T, emplace);
         if(this->has_value())
-        {
-            this->value_.~T();
-            this->is_set_ = false;
-        }
+            this->hard_reset();
         this->construct(std::forward<Args>(args)...);
         return **this;
     }
 
     template<typename U, typename... Args>
-    T& emplace(std::initializer_list<U> ilist, Args&&... args)
+    constexpr T& emplace(std::initializer_list<U> ilist, Args&&... args)
     {
         static_assert(std::is_constructible<T, std::initializer_list<U>, Args...>::value,
                 "T must be constructible with initializer_list<U> and Args\n");
+        PD_OPTIONAL_RECORD(T, emplace);
         if(this->has_value())
-        {
-            this->value_.~T();
-            this->is_set_ = false;
-        }
+            this->hard_reset();
         this->construct(ilist, std::forward<Args>(args)...);
         return **this;
     }
+
+    // trivially copyable T is swapped as whole objects, flag or
+    // sentinel included, which compiles to plain loads and stores
+    // without branching on engagement. Otherwise both engaged swaps
+    // values, one engaged moves its value across and destroys source
+    constexpr void swap(optional &other) noexcept(std::is_nothrow_move_constructible<T>::value &&
+                                        std::is_nothrow_swappable<T>::value)
+    {
+        if constexpr (std::is_trivially_copy_constructible<T>::value &&
+                      std::is_trivially_copy_assignable<T>::value &&
+                      std::is_trivially_destructible<T>::value)
+        {
+            const optional tmp = *this;
+            *this = other;
+            other = tmp;
+        }
+        else if (this->has_value() && other.has_value())
+        {
+            using std::swap;
+            swap(this->value_, other.value_);
+        }
+        else if (this->has_value())
+        {
+            other.construct(std::move(this->value_));
+            this->hard_reset();
+        }
+        else if (other.has_value())
+        {
+            this->construct(std::move(other.value_));
+            other.hard_reset();
+        }
+    }
+
+private:
+    template<typename U>
+    friend struct optional;
+#ifdef PD_OPTIONAL_INSTRUMENT
+    friend struct detail::optional_counter_<T>;
+#endif
+
+    template<typename F, typename Arg>
+    constexpr optional(detail::invoke_tag_t tag, F &&f, Arg &&arg)
+        : base(tag, std::forward<F>(f), std::forward<Arg>(arg)) {}
 };
 
-} // namespace pd
+// optional<T&> stores single pointer, nullptr means empty.
+// Assignment rebinds the reference and never assigns through it.
+// Binding to temporaries is rejected
+template<typename T>
+struct optional<T&>
+{
+    using value_type = T&;
+
+    constexpr optional() noexcept = default;
+    constexpr optional(pd::nullopt_t) noexcept {}
+
+    constexpr optional(const optional&) noexcept = default;
+    constexpr optional& operator= (const optional&) noexcept = default;
+
+    template<typename U,
+             std::enable_if_t<std::is_convertible<U*, T*>::value> * = nullptr>
+    constexpr optional(U &u) noexcept : ptr_(std::addressof(u)) {}
+
+    optional(std::remove_const_t<T>&&) = delete;
+
+    template<typename U,
+             std::enable_if_t<std::is_convertible<U*, T*>::value> * = nullptr>
+    constexpr explicit optional(pd::in_place_t, U &u) noexcept : ptr_(std::addressof(u)) {}
+
+    template<typename U,
+             std::enable_if_t<std::is_convertible<U*, T*>::value> * = nullptr>
+    constexpr optional(const optional<U&> &other) noexcept
+        : ptr_(other.has_value() ? std::addressof(*other) : nullptr) {}
+
+    ~optional() = default;
+
+    constexpr optional& operator= (pd::nullopt_t) noexcept
+    {
+        ptr_ = nullptr;
+        return *this;
+    }
+
+    template<typename U,
+             std::enable_if_t<std::is_convertible<U*, T*>::value> * = nullptr>
+    constexpr optional& operator= (U &u) noexcept
+    {
+        ptr_ = std::addressof(u);
+        return *this;
+    }
+
+    optional& operator= (std::remove_const_t<T>&&) = delete;
+
+    constexpr T* operator->() const noexcept
+    {
+        return ptr_;
+    }
+
+    constexpr T& operator*() const noexcept
+    {
+        return *ptr_;
+    }
+
+    constexpr explicit operator bool() const noexcept
+    {
+        return ptr_ != nullptr;
+    }
+
+    constexpr bool has_value() const noexcept
+    {
+        return ptr_ != nullptr;
+    }
+
+    constexpr T& value() const
+    {
+        if (PD_OPTIONAL_LIKELY(this->has_value()))
+            return *ptr_;
+        PD_OPTIONAL_RECORD(T&, bad_access);
+        detail::throw_bad_optional_access();
+    }
+
+    template<typename U>
+    constexpr std::remove_cv_t<T> value_or(U &&u) const
+    {
+        static_assert(std::is_copy_constructible<std::remove_cv_t<T>>::value &&
+                      std::is_convertible<U&&, std::remove_cv_t<T>>::value,
+                      "T must be copy constructible and convertible from U\n");
+        return this->has_value() ? *ptr_ : static_cast<std::remove_cv_t<T>>(std::forward<U>(u));
+    }
+
+    constexpr void reset() noexcept
+    {
+        ptr_ = nullptr;
+    }
+
+    template<typename U,
+             std::enable_if_t<std::is_convertible<U*, T*>::value> * = nullptr>
+    constexpr T& emplace(U &u) noexcept
+    {
+        ptr_ = std::addressof(u);
+        return *ptr_;
+    }
+
+    // swaps bindings, referred objects are untouched
+    constexpr void swap(optional &other) noexcept
+    {
+        T *ptr = ptr_;
+        ptr_ = other.ptr_;
+        other.ptr_ = ptr;
+    }
+
+    template<typename F>
+    constexpr std::remove_cv_t<T> value_or_else(F &&f) const
+    {
+        return this->has_value() ? *ptr_ : static_cast<std::remove_cv_t<T>>(std::invoke(std::forward<F>(f)));
+    }
+
+    template<typename F>
+    constexpr auto and_then(F &&f) const
+    {
+        using U = detail::and_then_result_<F, T&>;
+        static_assert(detail::is_optional_<U>::value, "and_then callable must return pd::optional\n");
+        if (this->has_value())
+            return std::invoke(std::forward<F>(f), *ptr_);
+        return U(nullopt);
+    }
+
+    template<typename F>
+    constexpr auto transform(F &&f) const
+    {
+        using U = detail::transform_result_<F, T&>;
+        detail::check_transform_result_<U>();
+        if (this->has_value())
+            return optional<U>(detail::invoke_tag_t{}, std::forward<F>(f), *ptr_);
+        return optional<U>(nullopt);
+    }
+
+    template<typename F>
+    constexpr optional or_else(F &&f) const
+    {
+        static_assert(std::is_same<std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F>>>,
+                      optional>::value, "or_else callable must return optional<T&>\n");
+        return this->has_value() ? *this : std::invoke(std::forward<F>(f));
+    }
+
+private:
+    T *ptr_ = nullptr;
+};
+
+// comparisons live next to optional so that argument dependent lookup
+// finds them from any namespace, std::equal_to included
 
 template<typename T, typename U>
 inline constexpr bool operator==(const pd::optional<T> &lhs,
@@ -775,6 +1492,8 @@ inline constexpr bool operator>=(const U &lhs, const pd::optional<T> &rhs) {
       return rhs.has_value() ? lhs >= *rhs : true;
 }
 
+// found by argument dependent lookup, so std algorithms swapping
+// optionals use member swap instead of three moves
 template<typename T,
         std::enable_if_t<std::is_move_constructible<T>::value> * = nullptr,
         std::enable_if_t<std::is_swappable<T>::value> * = nullptr>
@@ -782,25 +1501,125 @@ void swap(pd::optional<T> &lhs, pd::optional<T> &rhs) noexcept(noexcept(lhs.swap
     return lhs.swap(rhs);
 }
 
-namespace pd
-{
-template<typename T>
+// barrier pack makes this overload deduction only, so explicit
+// make_optional<T>(...) always means in place construction of T,
+// including make_optional<T&>(t)
+template<int&... ExplicitArgumentBarrier, typename T>
 constexpr pd::optional<std::decay_t<T>> make_optional(T &&t)
 {
-    return pd::optional<T>(std::forward<T>(t));
+    return pd::optional<std::decay_t<T>>(std::forward<T>(t));
 }
 
 template<typename T, typename... Args>
-constexpr pd::optional<std::decay_t<T>> make_optional(Args&&... args)
+constexpr pd::optional<T> make_optional(Args&&... args)
 {
-    return pd::optional<T>(pd::in_place, std::forward<T>(args)...);
+    return pd::optional<T>(pd::in_place, std::forward<Args>(args)...);
 }
 
 template<typename T, typename U, typename... Args>
-constexpr pd::optional<std::decay_t<T>> make_optional(std::initializer_list<U> ilist, Args&&... args)
+constexpr pd::optional<T> make_optional(std::initializer_list<U> ilist, Args&&... args)
 {
-    return pd::optional<T>(pd::in_place, ilist, std::forward<T>(args)...);
+    return pd::optional<T>(pd::in_place, ilist, std::forward<Args>(args)...);
 }
+
+// make_optional_ref binds optional<T&> to t
+template<typename T>
+constexpr pd::optional<T&> make_optional_ref(T &t) noexcept
+{
+    return pd::optional<T&>(t);
+}
+
+template<typename T>
+pd::optional<const T&> make_optional_ref(const T&&) = delete;
+
+// is_trivially_relocatable tells whether moving T to a new address and
+// destroying the source can be done with plain memcpy/memmove.
+// Trivially copyable types are, specialize it for other types whose
+// objects do not depend on their own address
+template<typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+// optional<T> is just T plus flag (or sentinel), so it is
+// relocatable exactly when T is
+template<typename T>
+struct is_trivially_relocatable<optional<T>> : is_trivially_relocatable<T> {};
+
+template<typename T>
+constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+// relocate moves object from src into uninitialized dst
+// and ends lifetime of src, returns dst
+template<typename T>
+T* relocate(T *src, T *dst) noexcept(is_trivially_relocatable<T>::value ||
+                                     std::is_nothrow_move_constructible<T>::value)
+{
+    if constexpr (is_trivially_relocatable<T>::value)
+    {
+        std::memmove(static_cast<void*>(dst), static_cast<const void*>(src), sizeof(T));
+    }
+    else
+    {
+        ::new (static_cast<void*>(dst)) T(std::move(*src));
+        src->~T();
+    }
+    return dst;
+}
+
+// relocate_n relocates n objects from [first, first + n) into uninitialized
+// [dst, dst + n), returns dst + n. Trivially relocatable types are moved by
+// single memmove and ranges may overlap, for others ranges may overlap only
+// when dst < first
+template<typename T>
+T* relocate_n(T *first, std::size_t n, T *dst) noexcept(is_trivially_relocatable<T>::value ||
+                                                        std::is_nothrow_move_constructible<T>::value)
+{
+    if constexpr (is_trivially_relocatable<T>::value)
+    {
+        if (n)
+            std::memmove(static_cast<void*>(dst), static_cast<const void*>(first), n * sizeof(T));
+        return dst + n;
+    }
+    else
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            relocate(first + i, dst + i);
+        return dst + n;
+    }
+}
+
+namespace detail
+{
+
+// hash of engaged optional is hash of its value, so lookups by optional
+// and by plain value agree; empty one hashes to fixed constant
+template<typename T, typename U = std::remove_cv_t<std::remove_reference_t<T>>, typename = void>
+struct optional_hash_
+{
+    // disabled like std::hash<U> itself
+    optional_hash_() = delete;
+    optional_hash_(const optional_hash_&) = delete;
+    optional_hash_& operator= (const optional_hash_&) = delete;
+};
+
+template<typename T, typename U>
+struct optional_hash_<T, U, std::enable_if_t<std::is_default_constructible<std::hash<U>>::value>>
+{
+    std::size_t operator()(const optional<T> &o) const
+        noexcept(noexcept(std::hash<U>()(std::declval<const U&>())))
+    {
+        return o.has_value() ? std::hash<U>()(*o) : static_cast<std::size_t>(-3333);
+    }
+};
+
+} // namespace detail
 } // namespace pd
 
+namespace std
+{
+
+template<typename T>
+struct hash<pd::optional<T>> : pd::detail::optional_hash_<T> {};
+
+} // namespace std
+
 #endif // PD_OPTIONAL_OPTIONAL_HH_
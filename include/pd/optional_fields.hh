@@ -0,0 +1,327 @@
+#ifndef PD_OPTIONAL_OPTIONAL_FIELDS_HH_
+#define PD_OPTIONAL_OPTIONAL_FIELDS_HH_
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <tuple>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+namespace detail
+{
+
+// smallest unsigned integer with at least N bits
+template<std::size_t N>
+using fields_mask_ = std::conditional_t<N <= 8, std::uint8_t,
+                     std::conditional_t<N <= 16, std::uint16_t,
+                     std::conditional_t<N <= 32, std::uint32_t, std::uint64_t>>>;
+
+// optional_fields_layout_ places fields by decreasing alignment, stable
+// for equal ones, so there is no padding between them. Offsets are
+// computed at compile time and the whole block is one byte array
+template<typename... Ts>
+struct optional_fields_layout_
+{
+    static constexpr std::size_t count = sizeof...(Ts);
+    static constexpr std::size_t align = std::max({alignof(Ts)...});
+
+    struct result_t
+    {
+        std::array<std::size_t, count> offsets;
+        std::size_t size;
+    };
+
+    static constexpr result_t compute() noexcept
+    {
+        constexpr std::array<std::size_t, count> sizes {sizeof(Ts)...};
+        constexpr std::array<std::size_t, count> aligns {alignof(Ts)...};
+        result_t r {};
+        std::size_t offset = 0;
+        for (std::size_t a = align; a > 0; a /= 2)
+            for (std::size_t i = 0; i < count; ++i)
+                if (aligns[i] == a)
+                {
+                    r.offsets[i] = offset;
+                    offset += sizes[i];
+                }
+        r.size = offset;
+        return r;
+    }
+
+    static constexpr result_t value = compute();
+};
+
+template<bool Trivial, typename... Ts>
+struct optional_fields_base_;
+
+// trivially copyable payloads make the whole aggregate trivially
+// copyable, copies are then a single memcpy of bytes and mask
+template<typename... Ts>
+struct optional_fields_base_<true, Ts...>
+{
+    using layout = optional_fields_layout_<Ts...>;
+    using mask_type = fields_mask_<sizeof...(Ts)>;
+
+    alignas(layout::align) unsigned char bytes_[layout::value.size];
+    mask_type mask_ = 0;
+};
+
+template<typename... Ts>
+struct optional_fields_base_<false, Ts...>
+{
+    using layout = optional_fields_layout_<Ts...>;
+    using mask_type = fields_mask_<sizeof...(Ts)>;
+
+    optional_fields_base_() noexcept = default;
+
+    optional_fields_base_(const optional_fields_base_ &other)
+    {
+        copy_from(other, std::index_sequence_for<Ts...>());
+    }
+
+    optional_fields_base_(optional_fields_base_ &&other)
+        noexcept(std::conjunction<std::is_nothrow_move_constructible<Ts>...>::value)
+    {
+        move_from(other, std::index_sequence_for<Ts...>());
+    }
+
+    optional_fields_base_& operator= (const optional_fields_base_ &other)
+    {
+        if (this != &other)
+        {
+            destroy(std::index_sequence_for<Ts...>());
+            copy_from(other, std::index_sequence_for<Ts...>());
+        }
+        return *this;
+    }
+
+    optional_fields_base_& operator= (optional_fields_base_ &&other)
+        noexcept(std::conjunction<std::is_nothrow_move_constructible<Ts>...>::value)
+    {
+        if (this != &other)
+        {
+            destroy(std::index_sequence_for<Ts...>());
+            move_from(other, std::index_sequence_for<Ts...>());
+        }
+        return *this;
+    }
+
+    ~optional_fields_base_()
+    {
+        destroy(std::index_sequence_for<Ts...>());
+    }
+
+    alignas(layout::align) unsigned char bytes_[layout::value.size];
+    mask_type mask_ = 0;
+
+private:
+    template<std::size_t I>
+    using type_ = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+    template<std::size_t I>
+    type_<I>* ptr_() noexcept
+    {
+        return std::launder(reinterpret_cast<type_<I>*>(bytes_ + layout::value.offsets[I]));
+    }
+
+    template<std::size_t I>
+    const type_<I>* ptr_() const noexcept
+    {
+        return std::launder(reinterpret_cast<const type_<I>*>(bytes_ + layout::value.offsets[I]));
+    }
+
+    template<std::size_t I>
+    bool engaged_() const noexcept
+    {
+        return (mask_ >> I) & 1;
+    }
+
+    // mask bit is set per field, so a throwing copy leaves
+    // exactly the fields copied so far to the destructor
+    template<std::size_t... I>
+    void copy_from(const optional_fields_base_ &other, std::index_sequence<I...>)
+    {
+        mask_ = 0;
+        ((other.template engaged_<I>()
+            ? (void)(new (ptr_<I>()) type_<I>(*other.template ptr_<I>()), mask_ |= mask_type(1) << I)
+            : void()), ...);
+    }
+
+    template<std::size_t... I>
+    void move_from(optional_fields_base_ &other, std::index_sequence<I...>)
+    {
+        mask_ = 0;
+        ((other.template engaged_<I>()
+            ? (void)(new (ptr_<I>()) type_<I>(std::move(*other.template ptr_<I>())), mask_ |= mask_type(1) << I)
+            : void()), ...);
+    }
+
+    template<std::size_t... I>
+    void destroy(std::index_sequence<I...>) noexcept
+    {
+        ((engaged_<I>() ? ptr_<I>()->~type_<I>() : void()), ...);
+        mask_ = 0;
+    }
+};
+
+} // namespace detail
+
+// optional_fields is a tuple of optionals which keeps all engaged flags
+// in one shared mask word and packs payloads back to back ordered by
+// alignment, so a message with many optional fields costs its payload
+// plus one mask instead of flag and padding per field. Up to 64 fields
+template<typename... Ts>
+struct optional_fields
+    : private detail::optional_fields_base_<std::conjunction<std::is_trivially_copyable<Ts>...>::value, Ts...>
+{
+    static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) <= 64,
+            "optional_fields holds from 1 to 64 fields");
+    static_assert(std::conjunction<std::is_same<Ts, std::remove_cv_t<std::remove_reference_t<Ts>>>...>::value,
+            "optional_fields requires non-cv, non-reference types");
+
+private:
+    using base = detail::optional_fields_base_<std::conjunction<std::is_trivially_copyable<Ts>...>::value, Ts...>;
+    using layout = typename base::layout;
+
+public:
+    using mask_type = typename base::mask_type;
+
+    template<std::size_t I>
+    using field_type = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+    static constexpr std::size_t field_count = sizeof...(Ts);
+
+    optional_fields() noexcept = default;
+
+    template<std::size_t I>
+    bool has() const noexcept
+    {
+        check_index<I>();
+        return (this->mask_ >> I) & 1;
+    }
+
+    // view of field I, empty when field is not set
+    template<std::size_t I>
+    optional<field_type<I>&> get() noexcept
+    {
+        if (has<I>())
+            return optional<field_type<I>&>(*ptr<I>());
+        return nullopt;
+    }
+
+    template<std::size_t I>
+    optional<const field_type<I>&> get() const noexcept
+    {
+        if (has<I>())
+            return optional<const field_type<I>&>(*ptr<I>());
+        return nullopt;
+    }
+
+    template<std::size_t I, typename U>
+    field_type<I> value_or(U &&u) const
+    {
+        return has<I>() ? *ptr<I>() : static_cast<field_type<I>>(std::forward<U>(u));
+    }
+
+    template<std::size_t I, typename... Args>
+    field_type<I>& emplace(Args&&... args)
+    {
+        reset<I>();
+        new (ptr<I>()) field_type<I>(std::forward<Args>(args)...);
+        this->mask_ |= bit<I>();
+        return *ptr<I>();
+    }
+
+    template<std::size_t I>
+    void reset() noexcept
+    {
+        if (has<I>())
+        {
+            ptr<I>()->~field_type<I>();
+            this->mask_ &= static_cast<mask_type>(~bit<I>());
+        }
+    }
+
+    void reset() noexcept
+    {
+        reset_all(std::index_sequence_for<Ts...>());
+    }
+
+    // raw presence mask, bit I is set when field I is engaged
+    mask_type mask() const noexcept
+    {
+        return this->mask_;
+    }
+
+    // number of engaged fields
+    std::size_t count() const noexcept
+    {
+        return static_cast<std::size_t>(__builtin_popcountll(this->mask_));
+    }
+
+    // number of engaged fields among those selected by mask
+    std::size_t count(mask_type selection) const noexcept
+    {
+        return static_cast<std::size_t>(__builtin_popcountll(this->mask_ & selection));
+    }
+
+    bool any() const noexcept
+    {
+        return this->mask_ != 0;
+    }
+
+    bool all() const noexcept
+    {
+        return count() == field_count;
+    }
+
+    // mask selecting fields I..., for count(selection)
+    template<std::size_t... I>
+    static constexpr mask_type mask_of() noexcept
+    {
+        return static_cast<mask_type>((mask_type(0) | ... | bit<I>()));
+    }
+
+private:
+    template<std::size_t I>
+    static constexpr void check_index() noexcept
+    {
+        static_assert(I < sizeof...(Ts), "optional_fields index out of range");
+    }
+
+    template<std::size_t I>
+    static constexpr mask_type bit() noexcept
+    {
+        check_index<I>();
+        return static_cast<mask_type>(mask_type(1) << I);
+    }
+
+    template<std::size_t I>
+    field_type<I>* ptr() noexcept
+    {
+        return std::launder(reinterpret_cast<field_type<I>*>(this->bytes_ + layout::value.offsets[I]));
+    }
+
+    template<std::size_t I>
+    const field_type<I>* ptr() const noexcept
+    {
+        return std::launder(reinterpret_cast<const field_type<I>*>(this->bytes_ + layout::value.offsets[I]));
+    }
+
+    template<std::size_t... I>
+    void reset_all(std::index_sequence<I...>) noexcept
+    {
+        (reset<I>(), ...);
+    }
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_OPTIONAL_FIELDS_HH_
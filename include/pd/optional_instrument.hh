@@ -0,0 +1,274 @@
+#ifndef PD_OPTIONAL_OPTIONAL_INSTRUMENT_HH_
+#define PD_OPTIONAL_OPTIONAL_INSTRUMENT_HH_
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <typeinfo>
+#include <vector>
+
+// Lifecycle counters of optional<T>, per T, compiled in only with
+// PD_OPTIONAL_INSTRUMENT (optional.hh includes this header then).
+// Each thread counts into its own per type block with plain relaxed
+// loads and stores, no locked instruction and no sharing, block is
+// registered on first event of the thread and folded into totals when
+// thread exits. Instrumented optional is never trivially copyable,
+// since the copies it counts would otherwise be invisible memcpy
+namespace pd
+{
+namespace instrument
+{
+
+enum class event : unsigned
+{
+    default_construct,      // optional(), optional(nullopt)
+    in_place_construct,     // optional(in_place, args...)
+    value_construct,        // optional(u), T built from value
+    converting_construct,   // optional(optional<U>) of engaged one
+    copy_construct,         // optional(const optional&) of engaged one
+    move_construct,         // optional(optional&&) of engaged one
+    copy_assign,            // operator=(const optional&) from engaged one
+    move_assign,            // operator=(optional&&) from engaged one
+    value_assign,           // operator=(u), operator=(optional<U>)
+    emplace,
+    reset,                  // reset(), operator=(nullopt)
+    value_or_copy,          // value_or() returning copy of held value
+    bad_access              // value() of empty optional
+};
+
+constexpr std::size_t event_count = static_cast<std::size_t>(event::bad_access) + 1;
+
+inline const char* event_name(event e) noexcept
+{
+    static const char *const names[event_count] = {
+        "default", "in_place", "value", "converting", "copy", "move", "copy_assign",
+        "move_assign", "value_assign", "emplace", "reset", "value_or_copy", "bad_access"};
+    return names[static_cast<std::size_t>(e)];
+}
+
+// counters of one T summed over all threads
+struct type_report
+{
+    std::string type;
+    std::size_t size = 0;
+    std::uint64_t counts[event_count] = {};
+
+    std::uint64_t count(event e) const noexcept
+    {
+        return counts[static_cast<std::size_t>(e)];
+    }
+
+    // bytes of T duplicated: copies, conversions and value_or
+    std::uint64_t copied_bytes() const noexcept
+    {
+        return size * (count(event::copy_construct) + count(event::copy_assign) +
+                       count(event::converting_construct) + count(event::value_or_copy));
+    }
+
+    std::uint64_t moved_bytes() const noexcept
+    {
+        return size * (count(event::move_construct) + count(event::move_assign));
+    }
+};
+
+namespace detail
+{
+
+using counters_ = std::atomic<std::uint64_t>[event_count];
+
+struct type_record_
+{
+    std::string name;
+    std::size_t size;
+    std::uint64_t retired[event_count];
+    std::vector<const counters_*> live;
+};
+
+// leaked on purpose, threads may still exit after static destruction
+inline std::mutex& registry_mutex_()
+{
+    static std::mutex *m = new std::mutex;
+    return *m;
+}
+
+inline std::vector<type_record_*>& registry_()
+{
+    static std::vector<type_record_*> *r = new std::vector<type_record_*>;
+    return *r;
+}
+
+// folds blocks of exiting thread into totals of their types
+struct thread_blocks_
+{
+    std::vector<std::pair<type_record_*, const counters_*>> blocks;
+
+    ~thread_blocks_()
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex_());
+        for (auto [record, counts] : blocks)
+        {
+            for (std::size_t e = 0; e < event_count; ++e)
+                record->retired[e] += (*counts)[e].load(std::memory_order_relaxed);
+            record->live.erase(std::find(record->live.begin(), record->live.end(), counts));
+        }
+    }
+};
+
+template<typename T>
+std::string type_name_()
+{
+#if defined(__GNUC__)
+    const std::string_view f = __PRETTY_FUNCTION__;
+    const std::size_t b = f.find("T = ") + 4;
+    return std::string(f.substr(b, f.find_first_of(";]", b) - b));
+#else
+    return typeid(T).name();
+#endif
+}
+
+template<typename T>
+type_record_& type_record_of_()
+{
+    static type_record_ *record = []
+    {
+        auto *r = new type_record_{type_name_<T>(), sizeof(T), {}, {}};
+        std::lock_guard<std::mutex> lock(registry_mutex_());
+        registry_().push_back(r);
+        return r;
+    }();
+    return *record;
+}
+
+// constant initialized thread locals, access needs no guard
+template<typename T>
+struct thread_counters_
+{
+    static thread_local counters_ counts;
+    static thread_local bool attached;
+};
+
+template<typename T>
+thread_local counters_ thread_counters_<T>::counts = {};
+
+template<typename T>
+thread_local bool thread_counters_<T>::attached = false;
+
+// registers this thread's counters of T. Runs inside optional's noexcept
+// members, so failure to allocate or lock is swallowed and reported as
+// false, the event is dropped and next one tries again. Without
+// exceptions allocation failure terminates anyway
+template<typename T>
+[[gnu::noinline, gnu::cold]] bool attach_() noexcept
+{
+    static thread_local thread_blocks_ blocks;
+#ifndef PD_OPTIONAL_NO_EXCEPTIONS
+    try
+#endif
+    {
+        type_record_ &record = type_record_of_<T>();
+        // room first, so that nothing can fail once counters are live
+        blocks.blocks.reserve(blocks.blocks.size() + 1);
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex_());
+            record.live.push_back(&thread_counters_<T>::counts);
+        }
+        blocks.blocks.emplace_back(&record, &thread_counters_<T>::counts);
+    }
+#ifndef PD_OPTIONAL_NO_EXCEPTIONS
+    catch (...)
+    {
+        return false;
+    }
+#endif
+    thread_counters_<T>::attached = true;
+    return true;
+}
+
+template<typename T>
+void count_(event e) noexcept
+{
+    if (!thread_counters_<T>::attached && !attach_<T>())
+        return;
+    // single writer, plain load and store is enough
+    std::atomic<std::uint64_t> &c = thread_counters_<T>::counts[static_cast<std::size_t>(e)];
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// constant evaluation has no thread locals, events there are not counted
+template<typename T>
+constexpr void record_(event e) noexcept
+{
+    if (!__builtin_is_constant_evaluated())
+        count_<std::remove_cv_t<T>>(e);
+}
+
+} // namespace detail
+
+// counters of every type seen so far, most copied bytes first,
+// then most moved bytes
+inline std::vector<type_report> snapshot()
+{
+    std::vector<type_report> reports;
+    {
+        std::lock_guard<std::mutex> lock(detail::registry_mutex_());
+        for (const detail::type_record_ *record : detail::registry_())
+        {
+            type_report r;
+            r.type = record->name;
+            r.size = record->size;
+            for (std::size_t e = 0; e < event_count; ++e)
+            {
+                r.counts[e] = record->retired[e];
+                for (const detail::counters_ *counts : record->live)
+                    r.counts[e] += (*counts)[e].load(std::memory_order_relaxed);
+            }
+            reports.push_back(std::move(r));
+        }
+    }
+    std::stable_sort(reports.begin(), reports.end(), [](const type_report &a, const type_report &b)
+    {
+        if (a.copied_bytes() != b.copied_bytes())
+            return a.copied_bytes() > b.copied_bytes();
+        return a.moved_bytes() > b.moved_bytes();
+    });
+    return reports;
+}
+
+// zeroes all counters, meant for quiet points between phases,
+// events racing with it may survive
+inline void reset_counters()
+{
+    std::lock_guard<std::mutex> lock(detail::registry_mutex_());
+    for (detail::type_record_ *record : detail::registry_())
+    {
+        std::fill(std::begin(record->retired), std::end(record->retired), 0);
+        for (const detail::counters_ *counts : record->live)
+            for (auto &c : *const_cast<detail::counters_*>(counts))
+                c.store(0, std::memory_order_relaxed);
+    }
+}
+
+// one line per type in snapshot() order, only events which happened
+inline void dump(std::ostream &out)
+{
+    for (const type_report &r : snapshot())
+    {
+        out << "optional<" << r.type << "> size=" << r.size
+            << " copied_bytes=" << r.copied_bytes() << " moved_bytes=" << r.moved_bytes();
+        for (std::size_t e = 0; e < event_count; ++e)
+            if (r.counts[e])
+                out << ' ' << event_name(static_cast<event>(e)) << '=' << r.counts[e];
+        out << '\n';
+    }
+}
+
+} // namespace instrument
+} // namespace pd
+
+#endif // PD_OPTIONAL_OPTIONAL_INSTRUMENT_HH_
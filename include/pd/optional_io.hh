@@ -0,0 +1,387 @@
+#ifndef PD_OPTIONAL_OPTIONAL_IO_HH_
+#define PD_OPTIONAL_OPTIONAL_IO_HH_
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "optional.hh"
+#include "optional_vector.hh"
+
+namespace pd
+{
+
+// On-disk column of optional<T> for trivially copyable T, version 1.
+// All integers are in writer's native byte order, byte_order field lets
+// reader reject foreign files instead of silently misreading them.
+//
+//     offset 0    column_header, 64 bytes
+//     offset 64   payload, size * sizeof(T) bytes, empty slots hold zero
+//                 bytes or, when appended from optional_vector, value
+//                 initialized T
+//     aligned 64  validity bitmap, ceil(size / 64) little bit order
+//                 64 bit words, bit i % 64 of word i / 64 is set
+//                 when element i is engaged
+//
+// Bitmap goes last so writer can stream payload without knowing the
+// number of elements up front; header is written when writer finishes,
+// so file of unfinished writer has no magic and is rejected on open.
+// A single optional scalar is a column of one element
+struct column_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t type_tag;
+    std::uint32_t value_size;
+    std::uint64_t size;
+    std::uint64_t engaged;
+    std::uint64_t payload_offset;
+    std::uint64_t validity_offset;
+    std::uint64_t reserved;
+};
+
+static_assert(sizeof(column_header) == 64, "column_header must stay 64 bytes");
+
+// file is not a valid column of requested type
+struct format_error : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail
+{
+
+constexpr char column_magic_[8] = {'P', 'D', 'O', 'P', 'T', 'C', 'O', 'L'};
+constexpr std::uint32_t column_version_ = 1;
+constexpr std::uint32_t column_byte_order_ = 0x01020304;
+constexpr std::uint64_t column_align_ = 64;
+
+// kind of T in high half, size in low half, so int32 column
+// is never read back as float or uint32 one
+template<typename T>
+constexpr std::uint32_t column_type_tag_()
+{
+    const std::uint32_t kind = std::is_same<T, bool>::value ? 1
+                             : std::is_floating_point<T>::value ? 2
+                             : std::is_integral<T>::value && std::is_signed<T>::value ? 3
+                             : std::is_integral<T>::value ? 4
+                             : 5;
+    return kind << 16 | static_cast<std::uint32_t>(sizeof(T));
+}
+
+constexpr std::uint64_t column_align_up_(std::uint64_t n) noexcept
+{
+    return (n + column_align_ - 1) / column_align_ * column_align_;
+}
+
+[[noreturn]] inline void throw_errno_(const std::string &what)
+{
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace detail
+
+// column_writer streams optional<T> values to a file. Payload goes
+// through a fixed size buffer of its own, since fwrite per element pays
+// for stream locking every time, only the validity bitmap (one bit per
+// element) grows in memory until finish()
+template<typename T>
+struct column_writer
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+            "column_writer requires trivially copyable T");
+
+    using size_type = std::size_t;
+
+    explicit column_writer(const std::string &path)
+        : path_(path), file_(std::fopen(path.c_str(), "wb"))
+    {
+        if (!file_)
+            detail::throw_errno_("pd::column_writer: cannot open " + path);
+        buffer_.resize(buffer_bytes);
+        // placeholder, real header goes in on finish()
+        const column_header blank {};
+        write_bytes(&blank, sizeof(blank));
+    }
+
+    column_writer(const column_writer&) = delete;
+    column_writer& operator= (const column_writer&) = delete;
+
+    // unfinished file is left without magic so readers reject it
+    ~column_writer()
+    {
+        if (file_)
+            std::fclose(file_);
+    }
+
+    size_type size() const noexcept
+    {
+        return size_;
+    }
+
+    void push_back(const T &t)
+    {
+        buffer(&t);
+        push_bit(true);
+    }
+
+    void push_back(pd::nullopt_t)
+    {
+        const unsigned char zero[sizeof(T)] = {};
+        buffer(zero);
+        push_bit(false);
+    }
+
+    void push_back(const optional<T> &o)
+    {
+        if (o.has_value())
+            push_back(*o);
+        else
+            push_back(nullopt);
+    }
+
+    // bulk append of a whole column, word at a time when aligned
+    void append(const optional_vector<T> &column)
+    {
+        if (size_ % 64 == 0)
+        {
+            flush();
+            write_bytes(column.values(), column.size() * sizeof(T));
+            for (size_type w = 0; w < column.validity_words(); ++w)
+                bits_.push_back(column.validity()[w]);
+            engaged_ += column.count();
+            size_ += column.size();
+            return;
+        }
+        for (size_type i = 0; i < column.size(); ++i)
+            push_back(column[i]);
+    }
+
+    // writes bitmap and header and closes the file
+    void finish()
+    {
+        if (!file_)
+            return;
+        flush();
+        const std::uint64_t payload_end = sizeof(column_header) + std::uint64_t(size_) * sizeof(T);
+        const std::uint64_t validity_offset = detail::column_align_up_(payload_end);
+        const unsigned char pad[detail::column_align_] = {};
+        write_bytes(pad, validity_offset - payload_end);
+        write_bytes(bits_.data(), bits_.size() * sizeof(std::uint64_t));
+
+        column_header header {};
+        std::memcpy(header.magic, detail::column_magic_, sizeof(header.magic));
+        header.version = detail::column_version_;
+        header.byte_order = detail::column_byte_order_;
+        header.type_tag = detail::column_type_tag_<T>();
+        header.value_size = sizeof(T);
+        header.size = size_;
+        header.engaged = engaged_;
+        header.payload_offset = sizeof(column_header);
+        header.validity_offset = validity_offset;
+        if (std::fseek(file_, 0, SEEK_SET) != 0)
+            detail::throw_errno_("pd::column_writer: cannot seek " + path_);
+        write_bytes(&header, sizeof(header));
+
+        std::FILE *file = file_;
+        file_ = nullptr;
+        if (std::fclose(file) != 0)
+            detail::throw_errno_("pd::column_writer: cannot close " + path_);
+    }
+
+private:
+    static constexpr std::size_t buffer_bytes = 1 << 16;
+
+    void buffer(const void *value)
+    {
+        if (used_ + sizeof(T) > buffer_bytes)
+            flush();
+        std::memcpy(buffer_.data() + used_, value, sizeof(T));
+        used_ += sizeof(T);
+    }
+
+    void flush()
+    {
+        write_bytes(buffer_.data(), used_);
+        used_ = 0;
+    }
+
+    void write_bytes(const void *data, std::size_t n)
+    {
+        if (n && std::fwrite(data, 1, n, file_) != n)
+            detail::throw_errno_("pd::column_writer: cannot write " + path_);
+    }
+
+    void push_bit(bool engaged)
+    {
+        if (size_ % 64 == 0)
+            bits_.push_back(0);
+        if (engaged)
+        {
+            bits_.back() |= std::uint64_t(1) << (size_ % 64);
+            ++engaged_;
+        }
+        ++size_;
+    }
+
+    std::string path_;
+    std::FILE *file_;
+    std::vector<unsigned char> buffer_;
+    std::size_t used_ = 0;
+    std::vector<std::uint64_t> bits_;
+    size_type size_ = 0;
+    size_type engaged_ = 0;
+};
+
+// mapped_column maps a column file read only and serves its values in
+// place. Opening validates header and sizes only, pages are brought in
+// by the OS on first access, so load time does not depend on file size
+template<typename T>
+struct mapped_column
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+            "mapped_column requires trivially copyable T");
+
+    using value_type = T;
+    using size_type = std::size_t;
+
+    explicit mapped_column(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            detail::throw_errno_("pd::mapped_column: cannot open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            detail::throw_errno_("pd::mapped_column: cannot stat " + path);
+        }
+        length_ = static_cast<std::size_t>(st.st_size);
+        if (length_ < sizeof(column_header))
+        {
+            ::close(fd);
+            throw format_error("pd::mapped_column: " + path + " is too short");
+        }
+        void *data = ::mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+        const int err = errno;
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            errno = err;
+            detail::throw_errno_("pd::mapped_column: cannot map " + path);
+        }
+        data_ = static_cast<const unsigned char*>(data);
+        try
+        {
+            validate(path);
+        }
+        catch (...)
+        {
+            ::munmap(const_cast<unsigned char*>(data_), length_);
+            throw;
+        }
+    }
+
+    mapped_column(mapped_column &&other) noexcept
+        : data_(other.data_), length_(other.length_), header_(other.header_)
+    {
+        other.data_ = nullptr;
+    }
+
+    mapped_column(const mapped_column&) = delete;
+    mapped_column& operator= (const mapped_column&) = delete;
+
+    ~mapped_column()
+    {
+        if (data_)
+            ::munmap(const_cast<unsigned char*>(data_), length_);
+    }
+
+    size_type size() const noexcept
+    {
+        return static_cast<size_type>(header_.size);
+    }
+
+    // number of engaged elements as recorded by writer
+    size_type count() const noexcept
+    {
+        return static_cast<size_type>(header_.engaged);
+    }
+
+    bool has_value(size_type i) const noexcept
+    {
+        return (validity()[i / 64] >> (i % 64)) & 1;
+    }
+
+    optional<const T&> operator[](size_type i) const noexcept
+    {
+        if (has_value(i))
+            return optional<const T&>(values()[i]);
+        return nullopt;
+    }
+
+    // raw payload, see format description for empty slots
+    const T* values() const noexcept
+    {
+        return reinterpret_cast<const T*>(data_ + header_.payload_offset);
+    }
+
+    const std::uint64_t* validity() const noexcept
+    {
+        return reinterpret_cast<const std::uint64_t*>(data_ + header_.validity_offset);
+    }
+
+    size_type validity_words() const noexcept
+    {
+        return (size() + 63) / 64;
+    }
+
+    const column_header& header() const noexcept
+    {
+        return header_;
+    }
+
+private:
+    void validate(const std::string &path)
+    {
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, detail::column_magic_, sizeof(header_.magic)) != 0)
+            throw format_error("pd::mapped_column: " + path + " is not a finished column file");
+        if (header_.version != detail::column_version_)
+            throw format_error("pd::mapped_column: " + path + " has unsupported version");
+        if (header_.byte_order != detail::column_byte_order_)
+            throw format_error("pd::mapped_column: " + path + " has foreign byte order");
+        if (header_.type_tag != detail::column_type_tag_<T>() || header_.value_size != sizeof(T))
+            throw format_error("pd::mapped_column: " + path + " holds another value type");
+        // every term is bounded by file length before it is used in a sum
+        const bool fits = header_.size <= length_ / sizeof(T) &&
+                          header_.payload_offset <= length_ && header_.validity_offset <= length_ &&
+                          header_.payload_offset % alignof(T) == 0 && header_.validity_offset % 8 == 0 &&
+                          header_.payload_offset + header_.size * sizeof(T) <= header_.validity_offset &&
+                          header_.validity_offset + (header_.size + 63) / 64 * 8 <= length_;
+        if (!fits)
+            throw format_error("pd::mapped_column: " + path + " is truncated or corrupt");
+    }
+
+    const unsigned char *data_ = nullptr;
+    std::size_t length_ = 0;
+    column_header header_ {};
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_OPTIONAL_IO_HH_
@@ -0,0 +1,505 @@
+#ifndef PD_OPTIONAL_OPTIONAL_KERNELS_HH_
+#define PD_OPTIONAL_OPTIONAL_KERNELS_HH_
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "optional.hh"
+#include "optional_vector.hh"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PD_OPTIONAL_X86_DISPATCH 1
+#define PD_OPTIONAL_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#define PD_OPTIONAL_X86_DISPATCH 0
+#define PD_OPTIONAL_TARGET(isa)
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PD_OPTIONAL_ALWAYS_INLINE inline __attribute__((always_inline))
+#define PD_OPTIONAL_UNROLL _Pragma("GCC unroll 16")
+#else
+#define PD_OPTIONAL_ALWAYS_INLINE inline
+#define PD_OPTIONAL_UNROLL
+#endif
+
+namespace pd
+{
+
+// simd_level selects kernel flavour:
+// scalar - plain per element loop over has_value(), reference implementation
+// sse2   - 128 bit vector kernels compiled for baseline target
+// avx2   - 256 bit vector kernels compiled for avx2
+// avx512 - 512 bit vector kernels compiled for avx512, compaction uses vpcompress
+enum class simd_level
+{
+    scalar,
+    sse2,
+    avx2,
+    avx512,
+};
+
+// best level supported by the running cpu, detected once
+inline simd_level active_simd_level() noexcept
+{
+#if PD_OPTIONAL_X86_DISPATCH
+    static const simd_level level = []
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+            __builtin_cpu_supports("avx512dq") &&
+            __builtin_cpu_supports("avx512vl"))
+            return simd_level::avx512;
+        if (__builtin_cpu_supports("avx2"))
+            return simd_level::avx2;
+        if (__builtin_cpu_supports("sse2"))
+            return simd_level::sse2;
+        return simd_level::scalar;
+    }();
+    return level;
+#else
+    return simd_level::sse2;
+#endif
+}
+
+namespace detail
+{
+
+constexpr std::size_t kernel_block_ = 64;
+constexpr std::size_t kernel_accumulators_ = 4;
+
+PD_OPTIONAL_ALWAYS_INLINE bool kernel_bit_(const std::uint64_t *bits, std::size_t i) noexcept
+{
+    return (bits[i / kernel_block_] >> (i % kernel_block_)) & 1;
+}
+
+template<simd_level L>
+struct simd_width_ : std::integral_constant<std::size_t, 16> {};
+
+template<>
+struct simd_width_<simd_level::avx2> : std::integral_constant<std::size_t, 32> {};
+
+template<>
+struct simd_width_<simd_level::avx512> : std::integral_constant<std::size_t, 64> {};
+
+// simd_ wraps gcc/clang vector extensions of the level's register width.
+// The same code becomes sse2, avx2 or avx512 instructions depending on the
+// target of the dispatch function it is inlined into. Only 32 and 64 bit
+// lanes are vectorized, narrower types go through the scalar path.
+// Vectors never cross function boundaries by value, since those helpers
+// are compiled for baseline target too
+template<typename T, simd_level L>
+struct simd_
+{
+    static constexpr bool enabled = L != simd_level::scalar &&
+                                    (sizeof(T) == 4 || sizeof(T) == 8);
+    static constexpr std::size_t bytes = simd_width_<L>::value;
+    static constexpr std::size_t lanes = bytes / sizeof(T);
+    static constexpr std::size_t chunks = kernel_block_ / lanes;
+
+    using lane_t = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+    typedef T vec __attribute__((vector_size(bytes)));
+    typedef lane_t mask __attribute__((vector_size(bytes)));
+
+    static PD_OPTIONAL_ALWAYS_INLINE void load(vec &v, const T *p) noexcept
+    {
+        std::memcpy(&v, p, sizeof(v));
+    }
+
+    static PD_OPTIONAL_ALWAYS_INLINE void store(T *p, const vec &v) noexcept
+    {
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    template<std::size_t... Is>
+    static PD_OPTIONAL_ALWAYS_INLINE void lane_bits(mask &m, std::index_sequence<Is...>) noexcept
+    {
+        m = mask{(lane_t(1) << Is)...};
+    }
+
+    // lane k of m is all ones when bit k of bits is set
+    static PD_OPTIONAL_ALWAYS_INLINE void expand(mask &m, std::uint64_t bits) noexcept
+    {
+        mask select;
+        lane_bits(select, std::make_index_sequence<lanes>{});
+        m = (mask)(((mask{} + static_cast<lane_t>(bits)) & select) != 0);
+    }
+
+    // v = m ? v : other, lane by lane
+    static PD_OPTIONAL_ALWAYS_INLINE void blend(vec &v, const mask &m, const vec &other) noexcept
+    {
+        v = (vec)(((mask)v & m) | ((mask)other & ~m));
+    }
+};
+
+// every kernel below is a struct with static run<Level>(...) so that
+// the very same body can be instantiated inside differently targeted
+// dispatch functions.
+// vector kernels walk validity bitmap word by word: full words run
+// unmasked, empty words are skipped, mixed words are masked lane by lane.
+// partial trailing word is handled by scalar tail since values past
+// size() do not exist
+template<typename A>
+struct sum_kernel_
+{
+    template<simd_level L, typename T>
+    static PD_OPTIONAL_ALWAYS_INLINE A run(const T *v, const std::uint64_t *bits, std::size_t n)
+    {
+        A total = 0;
+        std::size_t i = 0;
+        if constexpr (simd_<T, L>::enabled && std::is_same<A, T>::value)
+        {
+            using simd = simd_<T, L>;
+            typename simd::vec acc[kernel_accumulators_] = {};
+            for (; i + kernel_block_ <= n; i += kernel_block_)
+            {
+                const std::uint64_t word = bits[i / kernel_block_];
+                if (!word)
+                    continue;
+                PD_OPTIONAL_UNROLL
+                for (std::size_t c = 0; c < simd::chunks; ++c)
+                {
+                    typename simd::vec x;
+                    simd::load(x, v + i + c * simd::lanes);
+                    if (word != ~std::uint64_t(0))
+                    {
+                        // empty lanes become all zero bits, that is 0 and +0.0
+                        typename simd::mask m;
+                        simd::expand(m, word >> (c * simd::lanes));
+                        x = (typename simd::vec)((typename simd::mask)x & m);
+                    }
+                    acc[c % kernel_accumulators_] += x;
+                }
+            }
+            for (std::size_t a = 0; a < kernel_accumulators_; ++a)
+                for (std::size_t k = 0; k < simd::lanes; ++k)
+                    total += acc[a][k];
+        }
+        for (; i < n; ++i)
+            if (kernel_bit_(bits, i))
+                total += static_cast<A>(v[i]);
+        return total;
+    }
+};
+
+// floating point min/max start from -+infinity, so infinite values are
+// returned as is. NaN propagates: any engaged NaN makes the result NaN.
+// Comparisons with NaN are false, so it is tracked apart from the running
+// extremum rather than folded into it
+template<bool Max>
+struct minmax_kernel_
+{
+    template<typename T>
+    static PD_OPTIONAL_ALWAYS_INLINE T pick(T a, T b) noexcept
+    {
+        return Max ? (a > b ? a : b) : (a < b ? a : b);
+    }
+
+    template<simd_level L, typename T>
+    static PD_OPTIONAL_ALWAYS_INLINE T run(const T *v, const std::uint64_t *bits, std::size_t n)
+    {
+        using limits = std::numeric_limits<T>;
+        constexpr bool floating = std::is_floating_point<T>::value;
+        constexpr T identity = floating ? (Max ? -limits::infinity() : limits::infinity())
+                                        : (Max ? limits::lowest() : limits::max());
+        T result = identity;
+        bool nan = false;
+        std::size_t i = 0;
+        if constexpr (simd_<T, L>::enabled)
+        {
+            using simd = simd_<T, L>;
+            using vec = typename simd::vec;
+            using mask = typename simd::mask;
+            const vec fill = vec{} + identity;
+            vec acc[kernel_accumulators_];
+            for (std::size_t a = 0; a < kernel_accumulators_; ++a)
+                acc[a] = fill;
+            mask nans = {};
+            for (; i + kernel_block_ <= n; i += kernel_block_)
+            {
+                const std::uint64_t word = bits[i / kernel_block_];
+                if (!word)
+                    continue;
+                PD_OPTIONAL_UNROLL
+                for (std::size_t c = 0; c < simd::chunks; ++c)
+                {
+                    vec x;
+                    simd::load(x, v + i + c * simd::lanes);
+                    if (word != ~std::uint64_t(0))
+                    {
+                        mask m;
+                        simd::expand(m, word >> (c * simd::lanes));
+                        simd::blend(x, m, fill);
+                    }
+                    if constexpr (floating)
+                        nans |= (mask)(x != x);
+                    vec &a = acc[c % kernel_accumulators_];
+                    simd::blend(x, (mask)(Max ? x > a : x < a), a);
+                    a = x;
+                }
+            }
+            for (std::size_t a = 0; a < kernel_accumulators_; ++a)
+                for (std::size_t k = 0; k < simd::lanes; ++k)
+                    result = pick(acc[a][k], result);
+            for (std::size_t k = 0; k < simd::lanes; ++k)
+                nan |= nans[k] != 0;
+        }
+        for (; i < n; ++i)
+            if (kernel_bit_(bits, i))
+            {
+                if constexpr (floating)
+                    nan |= v[i] != v[i];
+                result = pick(v[i], result);
+            }
+        if constexpr (floating)
+            if (nan)
+                return limits::quiet_NaN();
+        return result;
+    }
+};
+
+struct count_kernel_
+{
+    template<simd_level L, typename T>
+    static PD_OPTIONAL_ALWAYS_INLINE std::size_t run(const T *, const std::uint64_t *bits, std::size_t n)
+    {
+        std::size_t count = 0;
+        if (L == simd_level::scalar)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+                count += kernel_bit_(bits, i);
+            return count;
+        }
+        // bits past n are guaranteed to be zero
+        const std::size_t words = (n + kernel_block_ - 1) / kernel_block_;
+        for (std::size_t w = 0; w < words; ++w)
+            count += static_cast<std::size_t>(__builtin_popcountll(bits[w]));
+        return count;
+    }
+};
+
+struct fill_kernel_
+{
+    template<simd_level L, typename T>
+    static PD_OPTIONAL_ALWAYS_INLINE void run(const T *v, const std::uint64_t *bits, std::size_t n,
+                                              T fallback, T *out)
+    {
+        std::size_t i = 0;
+        if constexpr (simd_<T, L>::enabled)
+        {
+            using simd = simd_<T, L>;
+            const typename simd::vec fill = typename simd::vec{} + fallback;
+            for (; i + kernel_block_ <= n; i += kernel_block_)
+            {
+                const std::uint64_t word = bits[i / kernel_block_];
+                if (word == ~std::uint64_t(0))
+                {
+                    std::memcpy(out + i, v + i, kernel_block_ * sizeof(T));
+                    continue;
+                }
+                PD_OPTIONAL_UNROLL
+                for (std::size_t c = 0; c < simd::chunks; ++c)
+                {
+                    typename simd::vec x;
+                    typename simd::mask m;
+                    simd::load(x, v + i + c * simd::lanes);
+                    simd::expand(m, word >> (c * simd::lanes));
+                    simd::blend(x, m, fill);
+                    simd::store(out + i + c * simd::lanes, x);
+                }
+            }
+        }
+        for (; i < n; ++i)
+            out[i] = kernel_bit_(bits, i) ? v[i] : fallback;
+    }
+};
+
+#if PD_OPTIONAL_X86_DISPATCH
+// compresses whole 64 element blocks with vpcompress, returns number of
+// elements processed, tail is left to the caller
+template<typename T>
+PD_OPTIONAL_TARGET("avx512f,avx512bw,avx512vl,popcnt")
+std::size_t compact_avx512_(const T *v, const std::uint64_t *bits, std::size_t n, T *&out)
+{
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "vpcompress handles only 32 and 64 bit lanes");
+    constexpr std::size_t step = 64 / sizeof(T);
+    std::size_t i = 0;
+    for (; i + kernel_block_ <= n; i += kernel_block_)
+    {
+        const std::uint64_t word = bits[i / kernel_block_];
+        for (std::size_t j = 0; j < kernel_block_; j += step)
+        {
+            const unsigned mask = static_cast<unsigned>(word >> j) & ((1u << step) - 1);
+            const __m512i chunk = _mm512_loadu_si512(static_cast<const void*>(v + i + j));
+            if (sizeof(T) == 4)
+                _mm512_mask_compressstoreu_epi32(static_cast<void*>(out), static_cast<__mmask16>(mask), chunk);
+            else
+                _mm512_mask_compressstoreu_epi64(static_cast<void*>(out), static_cast<__mmask8>(mask), chunk);
+            out += __builtin_popcount(mask);
+        }
+    }
+    return i;
+}
+#endif
+
+struct compact_kernel_
+{
+    template<simd_level L, typename T>
+    static PD_OPTIONAL_ALWAYS_INLINE std::size_t run(const T *v, const std::uint64_t *bits, std::size_t n,
+                                                     T *out)
+    {
+        T *const begin = out;
+        std::size_t i = 0;
+#if PD_OPTIONAL_X86_DISPATCH
+        if constexpr (L == simd_level::avx512 && simd_<T, L>::enabled)
+            i = compact_avx512_(v, bits, n, out);
+#endif
+        if (L != simd_level::scalar)
+        {
+            for (; i + kernel_block_ <= n; i += kernel_block_)
+            {
+                std::uint64_t word = bits[i / kernel_block_];
+                if (word == ~std::uint64_t(0))
+                {
+                    std::memcpy(out, v + i, kernel_block_ * sizeof(T));
+                    out += kernel_block_;
+                    continue;
+                }
+                while (word)
+                {
+                    *out++ = v[i + static_cast<std::size_t>(__builtin_ctzll(word))];
+                    word &= word - 1;
+                }
+            }
+        }
+        for (; i < n; ++i)
+            if (kernel_bit_(bits, i))
+                *out++ = v[i];
+        return static_cast<std::size_t>(out - begin);
+    }
+};
+
+template<typename Kernel, typename... Args>
+PD_OPTIONAL_TARGET("avx512f,avx512bw,avx512dq,avx512vl,avx2,bmi,bmi2,popcnt")
+auto run_kernel_avx512_(Args... args)
+{
+    return Kernel::template run<simd_level::avx512>(args...);
+}
+
+template<typename Kernel, typename... Args>
+PD_OPTIONAL_TARGET("avx2,bmi,bmi2,popcnt")
+auto run_kernel_avx2_(Args... args)
+{
+    return Kernel::template run<simd_level::avx2>(args...);
+}
+
+template<typename Kernel, typename... Args>
+auto run_kernel_(simd_level level, Args... args)
+{
+    if (level > active_simd_level())
+        level = active_simd_level();
+    switch (level)
+    {
+#if PD_OPTIONAL_X86_DISPATCH
+    case simd_level::avx512:
+        return run_kernel_avx512_<Kernel>(args...);
+    case simd_level::avx2:
+        return run_kernel_avx2_<Kernel>(args...);
+#endif
+    case simd_level::scalar:
+        return Kernel::template run<simd_level::scalar>(args...);
+    default:
+        return Kernel::template run<simd_level::sse2>(args...);
+    }
+}
+
+template<typename T>
+constexpr void check_kernel_type_()
+{
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+            "optional column kernels require arithmetic non-bool T");
+}
+
+} // namespace detail
+
+// Column kernels over optional_vector. Every kernel accepts level to force
+// specific implementation, level above the one supported by cpu is lowered.
+// Floating point sum/mean reassociate additions and may differ from
+// sequential summation in the last bits
+
+template<typename T>
+std::size_t count_engaged(const optional_vector<T> &col, simd_level level = active_simd_level())
+{
+    return detail::run_kernel_<detail::count_kernel_>(level, col.values(), col.validity(), col.size());
+}
+
+// sum of engaged values, T{} for column without them
+template<typename T>
+T sum(const optional_vector<T> &col, simd_level level = active_simd_level())
+{
+    detail::check_kernel_type_<T>();
+    return detail::run_kernel_<detail::sum_kernel_<T>>(level, col.values(), col.validity(), col.size());
+}
+
+// min/max of engaged values, empty for column without them.
+// Infinities compare as usual, any engaged NaN gives NaN
+template<typename T>
+optional<T> min(const optional_vector<T> &col, simd_level level = active_simd_level())
+{
+    detail::check_kernel_type_<T>();
+    if (!count_engaged(col, level))
+        return nullopt;
+    return detail::run_kernel_<detail::minmax_kernel_<false>>(level, col.values(), col.validity(), col.size());
+}
+
+template<typename T>
+optional<T> max(const optional_vector<T> &col, simd_level level = active_simd_level())
+{
+    detail::check_kernel_type_<T>();
+    if (!count_engaged(col, level))
+        return nullopt;
+    return detail::run_kernel_<detail::minmax_kernel_<true>>(level, col.values(), col.validity(), col.size());
+}
+
+// mean is accumulated in double to avoid integer overflow, so only
+// double columns take the vector kernels, others stay scalar.
+// Result type is spelled dependent on T so that including this header
+// does not instantiate optional<double> before users specialize
+// optional_traits<double>
+template<typename T>
+auto mean(const optional_vector<T> &col, simd_level level = active_simd_level())
+    -> optional<std::conditional_t<true, double, T>>
+{
+    detail::check_kernel_type_<T>();
+    const std::size_t count = count_engaged(col, level);
+    if (!count)
+        return nullopt;
+    return detail::run_kernel_<detail::sum_kernel_<double>>(level, col.values(), col.validity(), col.size())
+        / static_cast<double>(count);
+}
+
+// writes col.size() elements into out: engaged values and fallback for empty ones
+template<typename T>
+void fill_value_or(const optional_vector<T> &col, T fallback, T *out,
+                   simd_level level = active_simd_level())
+{
+    detail::check_kernel_type_<T>();
+    detail::run_kernel_<detail::fill_kernel_>(level, col.values(), col.validity(), col.size(), fallback, out);
+}
+
+// writes engaged values densely into out, which must have room for
+// count_engaged(col) elements, returns number of written elements
+template<typename T>
+std::size_t compact(const optional_vector<T> &col, T *out, simd_level level = active_simd_level())
+{
+    detail::check_kernel_type_<T>();
+    return detail::run_kernel_<detail::compact_kernel_>(level, col.values(), col.validity(), col.size(), out);
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_OPTIONAL_KERNELS_HH_
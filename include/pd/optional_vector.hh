@@ -0,0 +1,375 @@
+#ifndef PD_OPTIONAL_OPTIONAL_VECTOR_HH_
+#define PD_OPTIONAL_OPTIONAL_VECTOR_HH_
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+// optional_vector is a struct-of-arrays column of optional values:
+// dense buffer of T plus validity bitmap with one bit per element.
+// Empty slots hold value initialized T, so the value buffer is
+// always safe to scan as a whole and only the bitmap decides
+// which elements are engaged
+template<typename T>
+struct optional_vector
+{
+    static_assert(std::is_default_constructible<T>::value,
+            "optional_vector requires default constructible T");
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "optional_vector requires non-cv, non-reference T");
+
+    using value_type = T;
+    using size_type = std::size_t;
+    using word_type = std::uint64_t;
+
+    static constexpr size_type word_bits = 64;
+
+    // reference is a proxy to a single slot, behaves like optional<T>&
+    struct reference
+    {
+        constexpr bool has_value() const noexcept
+        {
+            return vec_->has_value(idx_);
+        }
+
+        constexpr explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+
+        constexpr T& operator*() const noexcept
+        {
+            return vec_->values_[idx_];
+        }
+
+        constexpr T* operator->() const noexcept
+        {
+            return std::addressof(vec_->values_[idx_]);
+        }
+
+        constexpr T& value() const
+        {
+            if (PD_OPTIONAL_LIKELY(has_value()))
+                return **this;
+            detail::throw_bad_optional_access();
+        }
+
+        template<typename U>
+        constexpr T value_or(U &&u) const
+        {
+            return has_value() ? **this : static_cast<T>(std::forward<U>(u));
+        }
+
+        template<typename... Args>
+        T& emplace(Args&&... args)
+        {
+            return vec_->emplace(idx_, std::forward<Args>(args)...);
+        }
+
+        void reset()
+        {
+            vec_->reset(idx_);
+        }
+
+        reference& operator= (pd::nullopt_t)
+        {
+            reset();
+            return *this;
+        }
+
+        template<typename U = T,
+                 std::enable_if_t<std::is_assignable<T&, U&&>::value> * = nullptr>
+        reference& operator= (U &&u)
+        {
+            vec_->values_[idx_] = std::forward<U>(u);
+            vec_->set_bit(idx_);
+            return *this;
+        }
+
+        reference& operator= (const optional<T> &other)
+        {
+            if (other.has_value())
+                *this = *other;
+            else
+                reset();
+            return *this;
+        }
+
+        // copies slot value, not the reference itself
+        reference& operator= (const reference &other)
+        {
+            if (other.has_value())
+                *this = *other;
+            else
+                reset();
+            return *this;
+        }
+
+        operator optional<T>() const
+        {
+            return has_value() ? optional<T>(**this) : optional<T>();
+        }
+
+        reference(const reference&) = default;
+
+    private:
+        friend struct optional_vector;
+        friend struct const_reference;
+
+        constexpr reference(optional_vector *vec, size_type idx) noexcept
+            : vec_(vec), idx_(idx) {}
+
+        optional_vector *vec_;
+        size_type idx_;
+    };
+
+    struct const_reference
+    {
+        constexpr const_reference(const reference &ref) noexcept
+            : vec_(ref.vec_), idx_(ref.idx_) {}
+
+        constexpr bool has_value() const noexcept
+        {
+            return vec_->has_value(idx_);
+        }
+
+        constexpr explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+
+        constexpr const T& operator*() const noexcept
+        {
+            return vec_->values_[idx_];
+        }
+
+        constexpr const T* operator->() const noexcept
+        {
+            return std::addressof(vec_->values_[idx_]);
+        }
+
+        constexpr const T& value() const
+        {
+            if (PD_OPTIONAL_LIKELY(has_value()))
+                return **this;
+            detail::throw_bad_optional_access();
+        }
+
+        template<typename U>
+        constexpr T value_or(U &&u) const
+        {
+            return has_value() ? **this : static_cast<T>(std::forward<U>(u));
+        }
+
+        operator optional<T>() const
+        {
+            return has_value() ? optional<T>(**this) : optional<T>();
+        }
+
+    private:
+        friend struct optional_vector;
+
+        constexpr const_reference(const optional_vector *vec, size_type idx) noexcept
+            : vec_(vec), idx_(idx) {}
+
+        const optional_vector *vec_;
+        size_type idx_;
+    };
+
+    optional_vector() = default;
+
+    explicit optional_vector(size_type n)
+        : values_(n), bits_(words_for(n)) {}
+
+    optional_vector(std::initializer_list<optional<T>> ilist)
+    {
+        reserve(ilist.size());
+        for (const auto &o : ilist)
+            push_back(o);
+    }
+
+    size_type size() const noexcept
+    {
+        return values_.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return values_.empty();
+    }
+
+    void reserve(size_type n)
+    {
+        values_.reserve(n);
+        bits_.reserve(words_for(n));
+    }
+
+    void clear() noexcept
+    {
+        values_.clear();
+        bits_.clear();
+    }
+
+    // resize appends empty slots or drops trailing ones
+    void resize(size_type n)
+    {
+        values_.resize(n);
+        bits_.resize(words_for(n));
+        if (n % word_bits)
+            bits_.back() &= (word_type(1) << (n % word_bits)) - 1;
+    }
+
+    bool has_value(size_type i) const noexcept
+    {
+        return (bits_[i / word_bits] >> (i % word_bits)) & 1;
+    }
+
+    reference operator[](size_type i) noexcept
+    {
+        return reference(this, i);
+    }
+
+    const_reference operator[](size_type i) const noexcept
+    {
+        return const_reference(this, i);
+    }
+
+    void push_back(const T &t)
+    {
+        values_.push_back(t);
+        push_bit(true);
+    }
+
+    void push_back(T &&t)
+    {
+        values_.push_back(std::move(t));
+        push_bit(true);
+    }
+
+    void push_back(pd::nullopt_t)
+    {
+        values_.emplace_back();
+        push_bit(false);
+    }
+
+    void push_back(const optional<T> &o)
+    {
+        if (o.has_value())
+            push_back(*o);
+        else
+            push_back(nullopt);
+    }
+
+    void push_back(optional<T> &&o)
+    {
+        if (o.has_value())
+            push_back(std::move(*o));
+        else
+            push_back(nullopt);
+    }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        values_.emplace_back(std::forward<Args>(args)...);
+        push_bit(true);
+        return values_.back();
+    }
+
+    void pop_back()
+    {
+        clear_bit(size() - 1);
+        values_.pop_back();
+        if (size() % word_bits == 0)
+            bits_.pop_back();
+    }
+
+    template<typename... Args>
+    T& emplace(size_type i, Args&&... args)
+    {
+        values_[i] = T(std::forward<Args>(args)...);
+        set_bit(i);
+        return values_[i];
+    }
+
+    // empty slot gets value initialized T back so
+    // resources held by the old value are released
+    void reset(size_type i)
+    {
+        if (has_value(i))
+        {
+            values_[i] = T();
+            clear_bit(i);
+        }
+    }
+
+    // number of engaged elements
+    size_type count() const noexcept
+    {
+        size_type n = 0;
+        for (word_type w : bits_)
+            n += static_cast<size_type>(__builtin_popcountll(w));
+        return n;
+    }
+
+    // raw access for column kernels
+    const T* values() const noexcept
+    {
+        return values_.data();
+    }
+
+    T* values() noexcept
+    {
+        return values_.data();
+    }
+
+    // validity bitmap, bit i of word i / 64 is set when element i is engaged.
+    // bits past size() are always zero
+    const word_type* validity() const noexcept
+    {
+        return bits_.data();
+    }
+
+    size_type validity_words() const noexcept
+    {
+        return bits_.size();
+    }
+
+private:
+    static constexpr size_type words_for(size_type n) noexcept
+    {
+        return (n + word_bits - 1) / word_bits;
+    }
+
+    void push_bit(bool engaged)
+    {
+        const size_type i = values_.size() - 1;
+        if (i % word_bits == 0)
+            bits_.push_back(0);
+        if (engaged)
+            set_bit(i);
+    }
+
+    void set_bit(size_type i) noexcept
+    {
+        bits_[i / word_bits] |= word_type(1) << (i % word_bits);
+    }
+
+    void clear_bit(size_type i) noexcept
+    {
+        bits_[i / word_bits] &= ~(word_type(1) << (i % word_bits));
+    }
+
+    std::vector<T> values_;
+    std::vector<word_type> bits_;
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_OPTIONAL_VECTOR_HH_
@@ -0,0 +1,328 @@
+#ifndef PD_OPTIONAL_PARSE_OPTIONAL_HH_
+#define PD_OPTIONAL_PARSE_OPTIONAL_HH_
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "optional.hh"
+#include "optional_vector.hh"
+#include "optional_kernels.hh"
+
+#if PD_OPTIONAL_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace pd
+{
+
+struct parse_options
+{
+    // text meaning absent value, compared exactly after trimming
+    std::vector<std::string_view> null_tokens {"", "NULL", "null", "NA", "N/A"};
+    // strip spaces, tabs and \r around the field before parsing
+    bool trim = true;
+};
+
+inline const parse_options& default_parse_options()
+{
+    static const parse_options options;
+    return options;
+}
+
+enum class parse_status
+{
+    value,
+    null,
+    invalid
+};
+
+namespace detail
+{
+
+template<typename T>
+constexpr void check_parse_type_()
+{
+    static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+            "parse_optional supports arithmetic non-bool T");
+}
+
+inline std::string_view trim_field_(std::string_view s) noexcept
+{
+    auto blank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    while (!s.empty() && blank(s.front()))
+        s.remove_prefix(1);
+    while (!s.empty() && blank(s.back()))
+        s.remove_suffix(1);
+    return s;
+}
+
+inline bool is_null_token_(std::string_view s, const parse_options &options) noexcept
+{
+    for (std::string_view token : options.null_tokens)
+        if (token.size() == s.size() && token == s)
+            return true;
+    return false;
+}
+
+template<typename T>
+parse_status parse_field_(std::string_view s, const parse_options &options, T &value) noexcept
+{
+    if (options.trim)
+        s = trim_field_(s);
+    if (is_null_token_(s, options))
+        return parse_status::null;
+    // from_chars rejects leading '+', csv producers do not
+    if (s.size() > 1 && s.front() == '+' && s[1] != '-' && s[1] != '+')
+        s.remove_prefix(1);
+    const char *last = s.data() + s.size();
+    const auto result = std::from_chars(s.data(), last, value);
+    return result.ec == std::errc() && result.ptr == last ? parse_status::value : parse_status::invalid;
+}
+
+} // namespace detail
+
+// parse_optional reads whole s as T. Null tokens give empty optional,
+// so does malformed text, status tells the two apart. Never throws
+template<typename T>
+optional<T> parse_optional(std::string_view s, parse_status &status,
+                           const parse_options &options = default_parse_options()) noexcept
+{
+    detail::check_parse_type_<T>();
+    T value {};
+    status = detail::parse_field_(s, options, value);
+    if (status == parse_status::value)
+        return value;
+    return nullopt;
+}
+
+template<typename T>
+optional<T> parse_optional(std::string_view s, const parse_options &options = default_parse_options()) noexcept
+{
+    parse_status status;
+    return parse_optional<T>(s, status, options);
+}
+
+// counts of a batch parse, invalid fields are stored as empty
+struct parse_stats
+{
+    std::size_t values = 0;
+    std::size_t nulls = 0;
+    std::size_t invalid = 0;
+};
+
+namespace detail
+{
+
+// separator scanners set bit j of masks[k] when p[64 * k + j] is a or b,
+// for blocks * 64 bytes. They are separate functions per instruction set
+// since movemask has no vector extension equivalent, called once per
+// chunk of text so the call is amortized
+using separator_scan_ = void (*)(const char*, std::size_t, char, char, std::uint64_t*);
+
+inline void scan_separators_scalar_(const char *p, std::size_t blocks, char a, char b, std::uint64_t *masks)
+{
+    for (std::size_t k = 0; k < blocks; ++k, p += 64)
+    {
+        std::uint64_t m = 0;
+        for (std::size_t j = 0; j < 64; ++j)
+            m |= std::uint64_t(p[j] == a || p[j] == b) << j;
+        masks[k] = m;
+    }
+}
+
+#if PD_OPTIONAL_X86_DISPATCH
+
+PD_OPTIONAL_TARGET("sse2")
+inline void scan_separators_sse2_(const char *p, std::size_t blocks, char a, char b, std::uint64_t *masks)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    for (std::size_t k = 0; k < blocks; ++k, p += 64)
+    {
+        std::uint64_t m = 0;
+        for (int j = 0; j < 4; ++j)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * j));
+            const __m128i eq = _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb));
+            m |= std::uint64_t(static_cast<std::uint16_t>(_mm_movemask_epi8(eq))) << (16 * j);
+        }
+        masks[k] = m;
+    }
+}
+
+PD_OPTIONAL_TARGET("avx2")
+inline void scan_separators_avx2_(const char *p, std::size_t blocks, char a, char b, std::uint64_t *masks)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    for (std::size_t k = 0; k < blocks; ++k, p += 64)
+    {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        const __m256i eq_lo = _mm256_or_si256(_mm256_cmpeq_epi8(lo, va), _mm256_cmpeq_epi8(lo, vb));
+        const __m256i eq_hi = _mm256_or_si256(_mm256_cmpeq_epi8(hi, va), _mm256_cmpeq_epi8(hi, vb));
+        masks[k] = std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(eq_lo)))
+                 | std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(eq_hi))) << 32;
+    }
+}
+
+PD_OPTIONAL_TARGET("avx512f,avx512bw")
+inline void scan_separators_avx512_(const char *p, std::size_t blocks, char a, char b, std::uint64_t *masks)
+{
+    const __m512i va = _mm512_set1_epi8(a);
+    const __m512i vb = _mm512_set1_epi8(b);
+    for (std::size_t k = 0; k < blocks; ++k, p += 64)
+    {
+        const __m512i v = _mm512_loadu_si512(p);
+        masks[k] = _mm512_cmpeq_epi8_mask(v, va) | _mm512_cmpeq_epi8_mask(v, vb);
+    }
+}
+
+#endif
+
+inline separator_scan_ separator_scan_for_(simd_level level) noexcept
+{
+    if (level > active_simd_level())
+        level = active_simd_level();
+    switch (level)
+    {
+#if PD_OPTIONAL_X86_DISPATCH
+    case simd_level::avx512:
+        return scan_separators_avx512_;
+    case simd_level::avx2:
+        return scan_separators_avx2_;
+    case simd_level::sse2:
+        return scan_separators_sse2_;
+#endif
+    default:
+        return scan_separators_scalar_;
+    }
+}
+
+// calls on_field(field, terminator) for every field of text split at a
+// or b, terminator is the separator which ended the field or '\0' for
+// the last one. Text ending with separator ends with an empty field,
+// empty text has no fields at all
+template<typename OnField>
+void split_fields_(std::string_view text, char a, char b, simd_level level, OnField &&on_field)
+{
+    constexpr std::size_t chunk_blocks = 64;
+    const separator_scan_ scan = separator_scan_for_(level);
+    const char *p = text.data();
+    const std::size_t n = text.size();
+    std::uint64_t masks[chunk_blocks];
+    std::size_t start = 0;
+    std::size_t pos = 0;
+    while (n - pos >= 64)
+    {
+        const std::size_t blocks = std::min(chunk_blocks, (n - pos) / 64);
+        scan(p + pos, blocks, a, b, masks);
+        for (std::size_t k = 0; k < blocks; ++k)
+            for (std::uint64_t m = masks[k]; m; m &= m - 1)
+            {
+                const std::size_t end = pos + 64 * k + static_cast<std::size_t>(__builtin_ctzll(m));
+                on_field(std::string_view(p + start, end - start), p[end]);
+                start = end + 1;
+            }
+        pos += blocks * 64;
+    }
+    for (; pos < n; ++pos)
+        if (p[pos] == a || p[pos] == b)
+        {
+            on_field(std::string_view(p + start, pos - start), p[pos]);
+            start = pos + 1;
+        }
+    if (n != 0)
+        on_field(std::string_view(p + start, n - start), '\0');
+}
+
+template<typename T>
+void push_parsed_(std::string_view field, const parse_options &options,
+                  optional_vector<T> &out, parse_stats &stats)
+{
+    T value {};
+    switch (parse_field_(field, options, value))
+    {
+    case parse_status::value:
+        out.push_back(value);
+        ++stats.values;
+        break;
+    case parse_status::null:
+        out.push_back(nullopt);
+        ++stats.nulls;
+        break;
+    case parse_status::invalid:
+        out.push_back(nullopt);
+        ++stats.invalid;
+        break;
+    }
+}
+
+} // namespace detail
+
+// parse_column appends every delimiter separated field of text to out.
+// Trailing delimiter is followed by one more empty field, except for '\n'
+// which terminates the last line instead.
+// Separators are located with SIMD, 64 bytes per step
+template<typename T>
+parse_stats parse_column(std::string_view text, char delimiter, optional_vector<T> &out,
+                         const parse_options &options = default_parse_options(),
+                         simd_level level = active_simd_level())
+{
+    detail::check_parse_type_<T>();
+    parse_stats stats;
+    detail::split_fields_(text, delimiter, delimiter, level, [&](std::string_view field, char terminator)
+    {
+        if (terminator == '\0' && field.empty() && delimiter == '\n')
+            return;
+        detail::push_parsed_(field, options, out, stats);
+    });
+    return stats;
+}
+
+// parse_field appends field number `field` of every record of delimited
+// text (csv, tsv) to out. Records without that field count as invalid.
+// The last record needs no record_sep after it.
+// Quoting is not supported, numeric columns do not need it
+template<typename T>
+parse_stats parse_field(std::string_view text, std::size_t field, char field_sep, char record_sep,
+                        optional_vector<T> &out, const parse_options &options = default_parse_options(),
+                        simd_level level = active_simd_level())
+{
+    detail::check_parse_type_<T>();
+    parse_stats stats;
+    std::size_t index = 0;
+    bool found = false;
+    detail::split_fields_(text, field_sep, record_sep, level, [&](std::string_view f, char terminator)
+    {
+        // nothing follows record_sep which closed the last record
+        if (terminator == '\0' && index == 0 && f.empty())
+            return;
+        if (index == field)
+        {
+            detail::push_parsed_(f, options, out, stats);
+            found = true;
+        }
+        if (terminator == field_sep)
+        {
+            ++index;
+            return;
+        }
+        if (!found)
+        {
+            out.push_back(nullopt);
+            ++stats.invalid;
+        }
+        index = 0;
+        found = false;
+    });
+    return stats;
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_PARSE_OPTIONAL_HH_
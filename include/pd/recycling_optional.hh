@@ -0,0 +1,350 @@
+#ifndef PD_OPTIONAL_RECYCLING_OPTIONAL_HH_
+#define PD_OPTIONAL_RECYCLING_OPTIONAL_HH_
+#pragma once
+
+#include "optional.hh"
+
+namespace pd
+{
+
+// recycle_traits<T>::clear empties value which recycling_optional
+// keeps alive after reset(), so next emplace or assignment reuses its
+// capacity. Default calls clear() member when T has one and assigns T()
+// otherwise, specialize recycle_traits<T> for types needing more
+template<typename T, typename = void>
+struct recycle_traits
+{
+    static void clear(T &value)
+    {
+        value = T();
+    }
+};
+
+template<typename T>
+struct recycle_traits<T, std::void_t<decltype(std::declval<T&>().clear())>>
+{
+    static void clear(T &value) noexcept(noexcept(value.clear()))
+    {
+        value.clear();
+    }
+};
+
+template<typename T, typename Recycle>
+struct recycling_optional;
+
+namespace detail
+{
+
+// U which single argument constructor and assignment take as value
+template<typename Self, typename U>
+struct recycling_argument_;
+
+template<typename T, typename Recycle, typename U>
+struct recycling_argument_<recycling_optional<T, Recycle>, U> : std::integral_constant<bool,
+    std::is_constructible<T, U>::value &&
+    !std::is_same<std::decay_t<U>, recycling_optional<T, Recycle>>::value &&
+    !std::is_same<std::decay_t<U>, pd::in_place_t>::value &&
+    !std::is_same<std::decay_t<U>, nullopt_t>::value> {};
+
+} // namespace detail
+
+// recycling_optional is optional whose reset() only clears value with
+// Recycle::clear and marks it empty, object itself with buffers it owns
+// stays constructed. emplace() without arguments hands that cleared
+// object back, emplace of single argument T is assignable from and
+// assignment of value assign into it, so parse loops going through
+// reset and emplace allocate only while capacity still grows. Other
+// emplace builds temporary and moves it in. shrink() really destroys
+// the object. Copies and moves carry logical value only, never capacity
+template<typename T, typename Recycle = recycle_traits<T>>
+struct recycling_optional
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "recycling_optional requires non-cv, non-reference T");
+    static_assert(std::is_move_assignable<T>::value,
+            "recycling_optional requires move assignable T");
+
+    using value_type = T;
+
+    constexpr recycling_optional() noexcept = default;
+
+    constexpr recycling_optional(nullopt_t) noexcept {}
+
+    template<typename... Args, typename = std::enable_if_t<std::is_constructible<T, Args...>::value>>
+    explicit recycling_optional(pd::in_place_t, Args&&... args)
+    {
+        cell_.construct(std::forward<Args>(args)...);
+        engaged_ = true;
+    }
+
+    template<typename U = T,
+             typename = std::enable_if_t<detail::recycling_argument_<recycling_optional, U>::value>>
+    recycling_optional(U &&u)
+    {
+        cell_.construct(std::forward<U>(u));
+        engaged_ = true;
+    }
+
+    recycling_optional(const recycling_optional &other)
+    {
+        if (other.engaged_)
+        {
+            cell_.construct(*other);
+            engaged_ = true;
+        }
+    }
+
+    recycling_optional(recycling_optional &&other) noexcept(std::is_nothrow_move_constructible<T>::value)
+    {
+        if (other.engaged_)
+        {
+            cell_.construct(std::move(*other));
+            engaged_ = true;
+        }
+    }
+
+    recycling_optional& operator= (nullopt_t) noexcept(noexcept(Recycle::clear(std::declval<T&>())))
+    {
+        reset();
+        return *this;
+    }
+
+    recycling_optional& operator= (const recycling_optional &other)
+    {
+        if (other.engaged_)
+            assign_(*other);
+        else
+            reset();
+        return *this;
+    }
+
+    recycling_optional& operator= (recycling_optional &&other)
+        noexcept(std::is_nothrow_move_assignable<T>::value && std::is_nothrow_move_constructible<T>::value &&
+                 noexcept(Recycle::clear(std::declval<T&>())))
+    {
+        if (other.engaged_)
+            assign_(std::move(*other));
+        else
+            reset();
+        return *this;
+    }
+
+    template<typename U = T,
+             typename = std::enable_if_t<detail::recycling_argument_<recycling_optional, U>::value &&
+                                         std::is_assignable<T&, U>::value>>
+    recycling_optional& operator= (U &&u)
+    {
+        assign_(std::forward<U>(u));
+        return *this;
+    }
+
+    // cleared kept object, or new one built from nothing
+    T& emplace()
+    {
+        if (!cell_.has_value())
+            cell_.construct();
+        else if (engaged_)
+            Recycle::clear(cell_.get());
+        engaged_ = true;
+        return cell_.get();
+    }
+
+    template<typename Arg, typename... Args>
+    T& emplace(Arg &&arg, Args&&... args)
+    {
+        if constexpr (sizeof...(Args) == 0 && std::is_constructible<T, Arg>::value &&
+                      std::is_assignable<T&, Arg>::value)
+            assign_(std::forward<Arg>(arg));
+        else if (cell_.has_value())
+        {
+            cell_.get() = T(std::forward<Arg>(arg), std::forward<Args>(args)...);
+            engaged_ = true;
+        }
+        else
+        {
+            cell_.construct(std::forward<Arg>(arg), std::forward<Args>(args)...);
+            engaged_ = true;
+        }
+        return cell_.get();
+    }
+
+    // empties logically, object and its capacity stay for reuse
+    void reset() noexcept(noexcept(Recycle::clear(std::declval<T&>())))
+    {
+        if (engaged_)
+        {
+            Recycle::clear(cell_.get());
+            engaged_ = false;
+        }
+    }
+
+    // destroys kept object, releasing whatever it holds
+    void shrink() noexcept
+    {
+        if (cell_.has_value())
+            cell_.hard_reset();
+        engaged_ = false;
+    }
+
+    // true while constructed object is around, engaged or recycled
+    bool holds_object() const noexcept
+    {
+        return cell_.has_value();
+    }
+
+    void swap(recycling_optional &other)
+        noexcept(std::is_nothrow_move_constructible<T>::value && std::is_nothrow_swappable<T>::value)
+    {
+        if (cell_.has_value() && other.cell_.has_value())
+        {
+            using std::swap;
+            swap(cell_.get(), other.cell_.get());
+        }
+        else if (cell_.has_value())
+        {
+            other.cell_.construct(std::move(cell_.get()));
+            cell_.hard_reset();
+        }
+        else if (other.cell_.has_value())
+        {
+            cell_.construct(std::move(other.cell_.get()));
+            other.cell_.hard_reset();
+        }
+        std::swap(engaged_, other.engaged_);
+    }
+
+    bool has_value() const noexcept
+    {
+        return engaged_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return engaged_;
+    }
+
+    T& operator* () & noexcept
+    {
+        return cell_.get();
+    }
+
+    const T& operator* () const & noexcept
+    {
+        return cell_.get();
+    }
+
+    T&& operator* () && noexcept
+    {
+        return std::move(cell_).get();
+    }
+
+    T* operator-> () noexcept
+    {
+        return std::addressof(cell_.get());
+    }
+
+    const T* operator-> () const noexcept
+    {
+        return std::addressof(cell_.get());
+    }
+
+    T& value() &
+    {
+        if (PD_OPTIONAL_LIKELY(engaged_))
+            return cell_.get();
+        detail::throw_bad_optional_access();
+    }
+
+    const T& value() const &
+    {
+        if (PD_OPTIONAL_LIKELY(engaged_))
+            return cell_.get();
+        detail::throw_bad_optional_access();
+    }
+
+    T&& value() &&
+    {
+        if (PD_OPTIONAL_LIKELY(engaged_))
+            return std::move(cell_).get();
+        detail::throw_bad_optional_access();
+    }
+
+    template<typename U>
+    T value_or(U &&default_value) const &
+    {
+        return engaged_ ? cell_.get() : static_cast<T>(std::forward<U>(default_value));
+    }
+
+    template<typename U>
+    T value_or(U &&default_value) &&
+    {
+        return engaged_ ? std::move(cell_.get()) : static_cast<T>(std::forward<U>(default_value));
+    }
+
+private:
+    template<typename U>
+    void assign_(U &&u)
+    {
+        if (cell_.has_value())
+            cell_.get() = std::forward<U>(u);
+        else
+            cell_.construct(std::forward<U>(u));
+        engaged_ = true;
+    }
+
+    detail::optional_operations_<T> cell_;
+    bool engaged_ = false;
+};
+
+template<typename T, typename Recycle>
+void swap(recycling_optional<T, Recycle> &lhs, recycling_optional<T, Recycle> &rhs)
+    noexcept(noexcept(lhs.swap(rhs)))
+{
+    lhs.swap(rhs);
+}
+
+template<typename T, typename Recycle>
+bool operator== (const recycling_optional<T, Recycle> &lhs, const recycling_optional<T, Recycle> &rhs)
+{
+    if (lhs.has_value() != rhs.has_value())
+        return false;
+    return !lhs.has_value() || *lhs == *rhs;
+}
+
+template<typename T, typename Recycle>
+bool operator!= (const recycling_optional<T, Recycle> &lhs, const recycling_optional<T, Recycle> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+template<typename T, typename Recycle>
+bool operator== (const recycling_optional<T, Recycle> &lhs, nullopt_t) noexcept
+{
+    return !lhs.has_value();
+}
+
+template<typename T, typename Recycle>
+bool operator!= (const recycling_optional<T, Recycle> &lhs, nullopt_t) noexcept
+{
+    return lhs.has_value();
+}
+
+template<typename T, typename Recycle, typename U,
+         typename = std::enable_if_t<!std::is_same<U, nullopt_t>::value &&
+                                     !std::is_same<U, recycling_optional<T, Recycle>>::value>>
+bool operator== (const recycling_optional<T, Recycle> &lhs, const U &rhs)
+{
+    return lhs.has_value() && *lhs == rhs;
+}
+
+template<typename T, typename Recycle, typename U,
+         typename = std::enable_if_t<!std::is_same<U, nullopt_t>::value &&
+                                     !std::is_same<U, recycling_optional<T, Recycle>>::value>>
+bool operator!= (const recycling_optional<T, Recycle> &lhs, const U &rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_RECYCLING_OPTIONAL_HH_
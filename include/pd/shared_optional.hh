@@ -0,0 +1,271 @@
+#ifndef PD_OPTIONAL_SHARED_OPTIONAL_HH_
+#define PD_OPTIONAL_SHARED_OPTIONAL_HH_
+#pragma once
+
+#include <atomic>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+namespace detail
+{
+
+// value together with count of shared_optional holding it
+template<typename T>
+struct shared_block_
+{
+    template<typename... Args>
+    explicit shared_block_(Args&&... args)
+        : value(std::forward<Args>(args)...) {}
+
+    std::atomic<std::size_t> refs {1};
+    T value;
+};
+
+} // namespace detail
+
+// shared_optional is optional whose value sits in one reference counted
+// block, copies share it and cost one atomic increment whatever T is.
+// Value is read only through observers, mutate() copies it first unless
+// this is its only holder (copy on write). Sole holder is also spared
+// locked instructions: count of one can not change under it, so release
+// and mutate() do plain acquire load. Copies always increment
+// atomically, since const copies of one shared_optional may race.
+// Like shared_ptr, one object must not be modified while other threads
+// use it, distinct copies may be used freely
+template<typename T>
+struct shared_optional
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "shared_optional requires non-cv, non-reference T");
+    static_assert(!std::is_same<T, in_place_t>::value && !std::is_same<T, nullopt_t>::value,
+            "instatiation with in_place_t or nullopt_t is ill-formed");
+
+    using value_type = T;
+
+    constexpr shared_optional() noexcept = default;
+
+    constexpr shared_optional(nullopt_t) noexcept {}
+
+    template<typename... Args, typename = std::enable_if_t<std::is_constructible<T, Args...>::value>>
+    explicit shared_optional(pd::in_place_t, Args&&... args)
+        : block_(new block_type(std::forward<Args>(args)...)) {}
+
+    template<typename U = T,
+             typename = std::enable_if_t<std::is_constructible<T, U>::value &&
+                                         !std::is_same<std::decay_t<U>, shared_optional>::value &&
+                                         !std::is_same<std::decay_t<U>, pd::in_place_t>::value &&
+                                         !std::is_same<std::decay_t<U>, nullopt_t>::value>>
+    shared_optional(U &&u)
+        : block_(new block_type(std::forward<U>(u))) {}
+
+    shared_optional(const optional<T> &other)
+        : block_(other.has_value() ? new block_type(*other) : nullptr) {}
+
+    shared_optional(optional<T> &&other)
+        : block_(other.has_value() ? new block_type(*std::move(other)) : nullptr) {}
+
+    shared_optional(const shared_optional &other) noexcept
+        : block_(other.block_)
+    {
+        if (block_)
+            block_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shared_optional(shared_optional &&other) noexcept
+        : block_(other.block_)
+    {
+        other.block_ = nullptr;
+    }
+
+    ~shared_optional()
+    {
+        release_();
+    }
+
+    shared_optional& operator= (nullopt_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    shared_optional& operator= (const shared_optional &other) noexcept
+    {
+        shared_optional(other).swap(*this);
+        return *this;
+    }
+
+    shared_optional& operator= (shared_optional &&other) noexcept
+    {
+        shared_optional(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    // sole holder assigns in place, shared value is left to others
+    template<typename U = T,
+             typename = std::enable_if_t<std::is_constructible<T, U>::value &&
+                                         std::is_assignable<T&, U>::value &&
+                                         !std::is_same<std::decay_t<U>, shared_optional>::value &&
+                                         !std::is_same<std::decay_t<U>, nullopt_t>::value>>
+    shared_optional& operator= (U &&u)
+    {
+        if (unique())
+            block_->value = std::forward<U>(u);
+        else
+            shared_optional(std::forward<U>(u)).swap(*this);
+        return *this;
+    }
+
+    // fresh block has one holder, so value may be written right away
+    template<typename... Args>
+    T& emplace(Args&&... args)
+    {
+        static_assert(std::is_constructible<T, Args...>::value,
+                "T must be constructible with Args\n");
+        block_type *fresh = new block_type(std::forward<Args>(args)...);
+        release_();
+        block_ = fresh;
+        return block_->value;
+    }
+
+    void reset() noexcept
+    {
+        release_();
+    }
+
+    // value for writing, copied into own block first when shared
+    T& mutate()
+    {
+        if (PD_OPTIONAL_LIKELY(block_ != nullptr))
+        {
+            if (block_->refs.load(std::memory_order_acquire) != 1)
+            {
+                block_type *copy = new block_type(block_->value);
+                release_();
+                block_ = copy;
+            }
+            return block_->value;
+        }
+        detail::throw_bad_optional_access();
+    }
+
+    void swap(shared_optional &other) noexcept
+    {
+        std::swap(block_, other.block_);
+    }
+
+    // holders of value, zero when empty. Exact only when other holders
+    // are quiet, as with shared_ptr::use_count
+    std::size_t use_count() const noexcept
+    {
+        return block_ ? block_->refs.load(std::memory_order_relaxed) : 0;
+    }
+
+    bool unique() const noexcept
+    {
+        return block_ && block_->refs.load(std::memory_order_acquire) == 1;
+    }
+
+    bool has_value() const noexcept
+    {
+        return block_ != nullptr;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return block_ != nullptr;
+    }
+
+    const T& operator* () const noexcept
+    {
+        return block_->value;
+    }
+
+    const T* operator-> () const noexcept
+    {
+        return &block_->value;
+    }
+
+    const T& value() const
+    {
+        if (PD_OPTIONAL_LIKELY(block_ != nullptr))
+            return block_->value;
+        detail::throw_bad_optional_access();
+    }
+
+    template<typename U>
+    T value_or(U &&u) const
+    {
+        return block_ ? block_->value : static_cast<T>(std::forward<U>(u));
+    }
+
+private:
+    using block_type = detail::shared_block_<T>;
+
+    // acquire pairs with release part of decrements of former holders,
+    // so their reads of value happen before destruction
+    void release_() noexcept
+    {
+        if (block_)
+        {
+            if (block_->refs.load(std::memory_order_acquire) == 1 ||
+                block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete block_;
+            block_ = nullptr;
+        }
+    }
+
+    block_type *block_ = nullptr;
+};
+
+template<typename T>
+void swap(shared_optional<T> &lhs, shared_optional<T> &rhs) noexcept
+{
+    lhs.swap(rhs);
+}
+
+template<typename T, typename U>
+bool operator== (const shared_optional<T> &lhs, const shared_optional<U> &rhs)
+{
+    if (lhs.has_value() != rhs.has_value())
+        return false;
+    return !lhs.has_value() || *lhs == *rhs;
+}
+
+template<typename T, typename U>
+bool operator!= (const shared_optional<T> &lhs, const shared_optional<U> &rhs)
+{
+    return !(lhs == rhs);
+}
+
+template<typename T>
+bool operator== (const shared_optional<T> &lhs, nullopt_t) noexcept
+{
+    return !lhs.has_value();
+}
+
+template<typename T>
+bool operator!= (const shared_optional<T> &lhs, nullopt_t) noexcept
+{
+    return lhs.has_value();
+}
+
+template<typename T, typename U,
+         std::enable_if_t<!std::is_same<U, nullopt_t>::value && !detail::is_optional_<U>::value> * = nullptr>
+bool operator== (const shared_optional<T> &lhs, const U &rhs)
+{
+    return lhs.has_value() && *lhs == rhs;
+}
+
+template<typename T, typename U,
+         std::enable_if_t<!std::is_same<U, nullopt_t>::value && !detail::is_optional_<U>::value> * = nullptr>
+bool operator!= (const shared_optional<T> &lhs, const U &rhs)
+{
+    return !(lhs == rhs);
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_SHARED_OPTIONAL_HH_
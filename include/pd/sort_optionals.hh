@@ -0,0 +1,195 @@
+#ifndef PD_OPTIONAL_SORT_OPTIONALS_HH_
+#define PD_OPTIONAL_SORT_OPTIONALS_HH_
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+// where empty optionals go relative to engaged ones
+enum class null_order
+{
+    first,
+    last
+};
+
+constexpr null_order nulls_first = null_order::first;
+constexpr null_order nulls_last = null_order::last;
+
+namespace detail
+{
+
+// arithmetic T up to 64 bits is radix sorted on its order preserving
+// unsigned key, long double and everything else is compared
+template<typename T>
+struct radix_sortable_ : std::integral_constant<bool,
+    (std::is_integral<T>::value || std::is_same<T, float>::value || std::is_same<T, double>::value) &&
+    sizeof(T) <= 8> {};
+
+template<typename T>
+using radix_key_ = std::conditional_t<sizeof(T) == 1, std::uint8_t,
+                   std::conditional_t<sizeof(T) == 2, std::uint16_t,
+                   std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>>>;
+
+// unsigned key whose order is order of operator< on T: sign bit flipped
+// for signed integers, all bits flipped for negative floats and sign
+// bit set for others. -0.0 gets key of 0.0 since they compare equal.
+// NaNs, which operator< cannot order, go past infinities on their side
+template<typename T>
+radix_key_<T> radix_key_of_(T v) noexcept
+{
+    using key = radix_key_<T>;
+    constexpr key sign = key(1) << (8 * sizeof(T) - 1);
+    if constexpr (std::is_floating_point<T>::value)
+    {
+        if (v == T(0))
+            v = T(0);
+        key k;
+        std::memcpy(&k, &v, sizeof(k));
+        return k ^ ((key(0) - (k >> (8 * sizeof(T) - 1))) | sign);
+    }
+    else if constexpr (std::is_signed<T>::value)
+        return static_cast<key>(static_cast<key>(v) ^ sign);
+    else
+        return static_cast<key>(v);
+}
+
+// LSD radix sort of values by byte of their key. Histograms of every
+// byte are taken in one read, byte positions where all values agree
+// are skipped, so narrow ranges in wide types pay only for bytes that
+// differ. Every pass is stable, so is the whole sort
+template<typename T>
+void radix_sort_(std::vector<T> &values)
+{
+    constexpr std::size_t bytes = sizeof(T);
+    const std::size_t n = values.size();
+    if (n < 2)
+        return;
+    std::vector<std::size_t> counts(bytes * 256);
+    for (const T &v : values)
+    {
+        auto k = radix_key_of_(v);
+        for (std::size_t b = 0; b < bytes; ++b, k >>= 8)
+            ++counts[b * 256 + (k & 0xff)];
+    }
+    std::vector<T> buffer(n);
+    for (std::size_t b = 0; b < bytes; ++b)
+    {
+        std::size_t *count = counts.data() + b * 256;
+        const std::size_t first_digit = radix_key_of_(values[0]) >> (8 * b) & 0xff;
+        if (count[first_digit] == n)
+            continue;
+        std::size_t offset = 0;
+        for (std::size_t d = 0; d < 256; ++d)
+        {
+            const std::size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (const T &v : values)
+            buffer[count[radix_key_of_(v) >> (8 * b) & 0xff]++] = v;
+        values.swap(buffer);
+    }
+}
+
+// below this many elements comparison sort beats histogram setup
+constexpr std::size_t radix_sort_threshold_ = 256;
+
+template<typename It>
+using sorted_optional_ = typename std::iterator_traits<It>::value_type;
+
+template<typename It>
+constexpr void check_sort_optionals_()
+{
+    static_assert(is_optional_<sorted_optional_<It>>::value,
+            "sort_optionals requires range of pd::optional");
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+                                  typename std::iterator_traits<It>::iterator_category>::value,
+            "sort_optionals requires random access iterators");
+}
+
+// float and double compare by radix key, which orders NaNs too, so
+// small ranges get the same total order as radix sorted ones and
+// std::sort is never handed NaN through operator<
+template<typename It>
+auto null_order_less_(null_order order)
+{
+    using T = typename sorted_optional_<It>::value_type;
+    return [order](const sorted_optional_<It> &lhs, const sorted_optional_<It> &rhs)
+    {
+        if (lhs.has_value() && rhs.has_value())
+        {
+            if constexpr (std::is_floating_point<T>::value && radix_sortable_<T>::value)
+                return radix_key_of_(*lhs) < radix_key_of_(*rhs);
+            else
+                return *lhs < *rhs;
+        }
+        return order == nulls_first ? rhs.has_value() : lhs.has_value();
+    };
+}
+
+// gathers engaged values, sorts them and writes range back with
+// empties in front or behind. Values carry their own bits through
+// stable passes, so -0.0 and 0.0 keep input order and one routine
+// serves both sort flavours
+template<typename It>
+void radix_sort_optionals_(It first, It last, null_order order)
+{
+    using T = typename sorted_optional_<It>::value_type;
+    std::vector<T> values;
+    values.reserve(static_cast<std::size_t>(last - first));
+    for (It it = first; it != last; ++it)
+        if (it->has_value())
+            values.push_back(**it);
+    radix_sort_(values);
+    const std::size_t empties = static_cast<std::size_t>(last - first) - values.size();
+    It out = first;
+    if (order == nulls_first)
+        for (std::size_t i = 0; i < empties; ++i, ++out)
+            *out = nullopt;
+    for (const T &v : values)
+        *out++ = v;
+    for (; out != last; ++out)
+        *out = nullopt;
+}
+
+} // namespace detail
+
+// sort_optionals sorts range of pd::optional<T> ascending by value with
+// empty ones first or last. Integral, float and double T are LSD radix
+// sorted in O(n) with one value sized buffer, other T fall back to
+// std::sort with the same order
+template<typename It>
+void sort_optionals(It first, It last, null_order order = nulls_first)
+{
+    detail::check_sort_optionals_<It>();
+    using T = typename detail::sorted_optional_<It>::value_type;
+    if constexpr (detail::radix_sortable_<T>::value)
+        if (static_cast<std::size_t>(last - first) >= detail::radix_sort_threshold_)
+            return detail::radix_sort_optionals_(first, last, order);
+    std::sort(first, last, detail::null_order_less_<It>(order));
+}
+
+// stable_sort_optionals keeps relative order of equal elements. Radix
+// sort is stable already, fallback is std::stable_sort
+template<typename It>
+void stable_sort_optionals(It first, It last, null_order order = nulls_first)
+{
+    detail::check_sort_optionals_<It>();
+    using T = typename detail::sorted_optional_<It>::value_type;
+    if constexpr (detail::radix_sortable_<T>::value)
+        if (static_cast<std::size_t>(last - first) >= detail::radix_sort_threshold_)
+            return detail::radix_sort_optionals_(first, last, order);
+    std::stable_sort(first, last, detail::null_order_less_<It>(order));
+}
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_SORT_OPTIONALS_HH_
@@ -0,0 +1,347 @@
+#ifndef PD_OPTIONAL_SPARSE_OPTIONAL_ARRAY_HH_
+#define PD_OPTIONAL_SPARSE_OPTIONAL_ARRAY_HH_
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "optional.hh"
+
+namespace pd
+{
+
+// sparse_optional_array is a fixed order array of optionals which keeps
+// only engaged values, densely and in index order, next to presence
+// bitmap. Bitmap is split in 256 bit blocks, each carrying number of
+// engaged entries before it, so rank of any index (position of its value)
+// is block rank plus at most four popcounts within the same block.
+// Blocks are five words and not padded, so one may straddle two cache lines.
+// Lookup of empty entry touches the bitmap only.
+// Appending is amortized O(1), set() of empty entry and reset() of
+// engaged one shift values and block ranks after it, O(size)
+template<typename T>
+struct sparse_optional_array
+{
+    static_assert(std::is_same<T, std::remove_cv_t<std::remove_reference_t<T>>>::value,
+            "sparse_optional_array requires non-cv, non-reference T");
+
+    using value_type = T;
+    using size_type = std::size_t;
+
+    // engaged entry as seen by iteration
+    struct entry
+    {
+        size_type index;
+        const T &value;
+    };
+
+    // forward iterator over engaged entries, walks bitmap with ctz
+    struct const_iterator
+    {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = entry;
+
+        entry operator*() const noexcept
+        {
+            return entry{word_ * word_bits + static_cast<size_type>(__builtin_ctzll(bits_)), *value_};
+        }
+
+        const_iterator& operator++() noexcept
+        {
+            bits_ &= bits_ - 1;
+            ++value_;
+            if (!bits_)
+                advance();
+            return *this;
+        }
+
+        const_iterator operator++(int) noexcept
+        {
+            const_iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        friend bool operator==(const const_iterator &lhs, const const_iterator &rhs) noexcept
+        {
+            return lhs.value_ == rhs.value_;
+        }
+
+        friend bool operator!=(const const_iterator &lhs, const const_iterator &rhs) noexcept
+        {
+            return lhs.value_ != rhs.value_;
+        }
+
+    private:
+        friend struct sparse_optional_array;
+
+        const_iterator(const sparse_optional_array *array, size_type word, const T *value) noexcept
+            : array_(array), word_(word), bits_(0), value_(value)
+        {
+            if (word_ < array_->words())
+            {
+                bits_ = array_->word(word_);
+                if (!bits_)
+                    advance();
+            }
+        }
+
+        // skips to next non-empty word
+        void advance() noexcept
+        {
+            const size_type words = array_->words();
+            while (++word_ < words)
+                if ((bits_ = array_->word(word_)))
+                    return;
+        }
+
+        const sparse_optional_array *array_;
+        size_type word_;
+        std::uint64_t bits_;
+        const T *value_;
+    };
+
+    using iterator = const_iterator;
+
+    sparse_optional_array() = default;
+
+    // n empty entries
+    explicit sparse_optional_array(size_type n)
+    {
+        resize(n);
+    }
+
+    sparse_optional_array(std::initializer_list<optional<T>> ilist)
+        : sparse_optional_array(ilist.begin(), ilist.end()) {}
+
+    // from any range of optional<T>-like elements
+    template<typename It>
+    sparse_optional_array(It first, It last)
+    {
+        for (; first != last; ++first)
+            push_back(*first);
+    }
+
+    size_type size() const noexcept
+    {
+        return size_;
+    }
+
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    // number of engaged entries
+    size_type count() const noexcept
+    {
+        return values_.size();
+    }
+
+    bool has_value(size_type i) const noexcept
+    {
+        return (word(i / word_bits) >> (i % word_bits)) & 1;
+    }
+
+    optional<const T&> operator[](size_type i) const noexcept
+    {
+        if (!has_value(i))
+            return nullopt;
+        return optional<const T&>(values_[rank(i)]);
+    }
+
+    // number of engaged entries with index below i
+    size_type rank(size_type i) const noexcept
+    {
+        const block_ &b = blocks_[i / block_bits];
+        const size_type w = (i % block_bits) / word_bits;
+        size_type r = b.rank;
+        for (size_type k = 0; k < w; ++k)
+            r += popcount(b.words[k]);
+        return r + popcount(b.words[w] & ((std::uint64_t(1) << (i % word_bits)) - 1));
+    }
+
+    // index of k-th engaged entry, k < count()
+    size_type select(size_type k) const noexcept
+    {
+        auto it = std::upper_bound(blocks_.begin(), blocks_.end(), k,
+                                   [](size_type k, const block_ &b) { return k < b.rank; });
+        const block_ &b = *(it - 1);
+        k -= b.rank;
+        size_type w = 0;
+        for (size_type c; (c = popcount(b.words[w])) <= k; ++w)
+            k -= c;
+        std::uint64_t bits = b.words[w];
+        for (; k; --k)
+            bits &= bits - 1;
+        return static_cast<size_type>(it - 1 - blocks_.begin()) * block_bits
+            + w * word_bits + static_cast<size_type>(__builtin_ctzll(bits));
+    }
+
+    const_iterator begin() const noexcept
+    {
+        return const_iterator(this, 0, values_.data());
+    }
+
+    const_iterator end() const noexcept
+    {
+        return const_iterator(this, words(), values_.data() + values_.size());
+    }
+
+    void push_back(pd::nullopt_t)
+    {
+        grow();
+    }
+
+    void push_back(const T &t)
+    {
+        grow();
+        values_.push_back(t);
+        mark(size_ - 1);
+    }
+
+    void push_back(T &&t)
+    {
+        grow();
+        values_.push_back(std::move(t));
+        mark(size_ - 1);
+    }
+
+    template<typename Option,
+             std::enable_if_t<!std::is_convertible<Option&&, const T&>::value> * = nullptr>
+    void push_back(Option &&o)
+    {
+        if (o.has_value())
+            push_back(*std::forward<Option>(o));
+        else
+            push_back(nullopt);
+    }
+
+    // appends empty entries or drops trailing ones
+    void resize(size_type n)
+    {
+        if (n < size_)
+        {
+            values_.erase(values_.begin() + static_cast<std::ptrdiff_t>(rank(n)), values_.end());
+            for (size_type i = n; i < size_ && i % block_bits; ++i)
+                unmark(i);
+            blocks_.resize((n + block_bits - 1) / block_bits);
+            size_ = n;
+        }
+        else
+        {
+            blocks_.resize((n + block_bits - 1) / block_bits, block_{values_.size(), {}});
+            size_ = n;
+        }
+    }
+
+    // assigns engaged entry in place, inserting into dense values otherwise
+    template<typename U = T>
+    T& set(size_type i, U &&u)
+    {
+        const size_type r = rank(i);
+        if (has_value(i))
+            return values_[r] = std::forward<U>(u);
+        values_.insert(values_.begin() + static_cast<std::ptrdiff_t>(r), std::forward<U>(u));
+        mark(i);
+        shift_ranks(i, 1);
+        return values_[r];
+    }
+
+    void reset(size_type i)
+    {
+        if (!has_value(i))
+            return;
+        values_.erase(values_.begin() + static_cast<std::ptrdiff_t>(rank(i)));
+        unmark(i);
+        shift_ranks(i, -1);
+    }
+
+    void clear() noexcept
+    {
+        values_.clear();
+        blocks_.clear();
+        size_ = 0;
+    }
+
+    void shrink_to_fit()
+    {
+        values_.shrink_to_fit();
+        blocks_.shrink_to_fit();
+    }
+
+    // dense engaged values in index order
+    const T* values() const noexcept
+    {
+        return values_.data();
+    }
+
+    // heap bytes held by values, bitmap and rank index
+    size_type memory_bytes() const noexcept
+    {
+        return values_.capacity() * sizeof(T) + blocks_.capacity() * sizeof(block_);
+    }
+
+private:
+    static constexpr size_type word_bits = 64;
+    static constexpr size_type block_words = 4;
+    static constexpr size_type block_bits = word_bits * block_words;
+
+    struct block_
+    {
+        size_type rank;
+        std::uint64_t words[block_words];
+    };
+
+    static size_type popcount(std::uint64_t w) noexcept
+    {
+        return static_cast<size_type>(__builtin_popcountll(w));
+    }
+
+    size_type words() const noexcept
+    {
+        return (size_ + word_bits - 1) / word_bits;
+    }
+
+    std::uint64_t word(size_type w) const noexcept
+    {
+        return blocks_[w / block_words].words[w % block_words];
+    }
+
+    void mark(size_type i) noexcept
+    {
+        blocks_[i / block_bits].words[(i % block_bits) / word_bits] |= std::uint64_t(1) << (i % word_bits);
+    }
+
+    void unmark(size_type i) noexcept
+    {
+        blocks_[i / block_bits].words[(i % block_bits) / word_bits] &= ~(std::uint64_t(1) << (i % word_bits));
+    }
+
+    void grow()
+    {
+        if (size_ % block_bits == 0)
+            blocks_.push_back(block_{values_.size(), {}});
+        ++size_;
+    }
+
+    void shift_ranks(size_type i, std::ptrdiff_t delta) noexcept
+    {
+        for (size_type b = i / block_bits + 1; b < blocks_.size(); ++b)
+            blocks_[b].rank += static_cast<size_type>(delta);
+    }
+
+    std::vector<block_> blocks_;
+    std::vector<T> values_;
+    size_type size_ = 0;
+};
+
+} // namespace pd
+
+#endif // PD_OPTIONAL_SPARSE_OPTIONAL_ARRAY_HH_
@@ -0,0 +1,79 @@
+// built with -std=c++20, every operation of optional must be usable in
+// constant evaluation, also for types with non-trivial special members
+#include <iostream>
+#include <utility>
+
+#include "../include/pd/optional.hh"
+
+#if !PD_OPTIONAL_HAS_CONSTRUCT_AT
+#error "C++20 build should use std::construct_at"
+#endif
+
+// literal type which counts its own special member calls
+struct Literal
+{
+    constexpr Literal(int v, int *destroyed) : value(v), destroyed(destroyed) {}
+    constexpr Literal(const Literal &other) : value(other.value), destroyed(other.destroyed) {}
+    constexpr Literal(Literal &&other) : value(other.value), destroyed(other.destroyed) { other.value = -1; }
+    constexpr Literal& operator=(const Literal &other)
+    {
+        value = other.value;
+        destroyed = other.destroyed;
+        return *this;
+    }
+    constexpr Literal& operator=(Literal &&other)
+    {
+        value = other.value;
+        destroyed = other.destroyed;
+        other.value = -1;
+        return *this;
+    }
+    constexpr ~Literal() { ++*destroyed; }
+
+    int value;
+    int *destroyed;
+};
+
+template<>
+struct pd::optional_traits<double> : pd::nan_traits<double> {};
+
+static_assert(!std::is_trivially_destructible<Literal>::value && !std::is_trivially_copyable<Literal>::value,
+        "Literal should exercise non-trivial paths");
+
+constexpr int lifecycle()
+{
+    int destroyed = 0;
+    {
+        pd::optional<Literal> a;
+        a.emplace(1, &destroyed);
+        pd::optional<Literal> b = a;
+        pd::optional<Literal> c = std::move(b);
+        a.reset();
+        a = c;
+        c = pd::nullopt;
+        b = std::move(a);
+        pd::optional<Literal> d;
+        d.swap(b);
+        if (b || !d || d->value != 1)
+            return -1;
+    }
+    return destroyed;
+}
+
+constexpr int nan_sentinel()
+{
+    pd::optional<double> o;
+    o = 2.5;
+    const bool engaged = o.has_value();
+    o.reset();
+    return engaged && !o ? 1 : 0;
+}
+
+static_assert(lifecycle() == 5, "every constructed Literal should be destroyed once");
+static_assert(nan_sentinel() == 1, "sentinel storage should be constexpr with std::bit_cast");
+
+int main()
+{
+    std::cout << " ----- RUNNING testConstexprCxx20 ----- \n";
+    return lifecycle() == 5 ? 0 : 1;
+}
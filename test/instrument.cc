@@ -0,0 +1,172 @@
+// built with -DPD_OPTIONAL_INSTRUMENT, lifecycle events must be counted
+// per type and summed over threads, including threads already gone
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/pd/optional.hh"
+
+#ifndef PD_OPTIONAL_INSTRUMENT
+#error "test/instrument.cc must be built with -DPD_OPTIONAL_INSTRUMENT"
+#endif
+
+using pd::instrument::event;
+
+struct Large
+{
+    char bytes[4096];
+};
+
+// lets a thread make its allocations fail
+thread_local bool fail_allocations = false;
+
+void* operator new(std::size_t n)
+{
+    void *p = fail_allocations ? nullptr : std::malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+struct Scarce
+{
+    explicit Scarce(int v) : value(v) {}
+    int value;
+};
+
+bool failed = false;
+
+void check(bool ok, const char *what)
+{
+    if (!ok)
+    {
+        std::cerr << "FAILED: " << what << '\n';
+        failed = true;
+    }
+}
+
+const pd::instrument::type_report* find(const std::vector<pd::instrument::type_report> &reports,
+                                        const std::string &type)
+{
+    for (const auto &r : reports)
+        if (r.type == type)
+            return &r;
+    return nullptr;
+}
+
+constexpr int constant()
+{
+    pd::optional<int> o;
+    o.emplace(4);
+    return *o;
+}
+
+int main()
+{
+    std::cout << " ----- RUNNING testInstrument ----- \n";
+    static_assert(constant() == 4, "instrumented optional should stay constexpr");
+
+    {
+        pd::optional<std::string> a;                         // default
+        pd::optional<std::string> b {pd::in_place, "x"};     // in_place
+        pd::optional<std::string> c = std::string("y");      // value
+        pd::optional<std::string> d = b;                     // copy
+        pd::optional<std::string> e = std::move(c);          // move
+        a = d;                                               // copy_assign
+        a = pd::optional<std::string>();                     // default, nothing assigned
+        a = "z";                                             // value_assign
+        a.emplace("w");                                      // emplace
+        a.reset();                                           // reset
+        a = pd::nullopt;                                     // empty already
+        std::string copy = b.value_or("");                   // value_or_copy
+        pd::optional<std::string> f = pd::optional<const char*>("v"); // value, converting
+        (void)copy;
+        (void)e;
+        (void)f;
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([]
+        {
+            pd::optional<Large> large {pd::in_place};
+            for (int i = 0; i < 100; ++i)
+            {
+                pd::optional<Large> copy = large;
+                (void)copy;
+            }
+        });
+    for (auto &t : threads)
+        t.join();
+
+    // first event of a thread cannot register under memory pressure,
+    // it is dropped instead of terminating inside noexcept members
+    std::thread([]
+    {
+        fail_allocations = true;
+        pd::optional<Scarce> first {pd::in_place, 1};
+        fail_allocations = false;
+        pd::optional<Scarce> second = first;
+        (void)second;
+    }).join();
+
+    pd::optional<int> empty;
+    try
+    {
+        (void)empty.value();
+    }
+    catch (const pd::bad_optional_access&)
+    {
+    }
+
+    const auto reports = pd::instrument::snapshot();
+    const auto *str = find(reports, "std::__cxx11::basic_string<char>");
+    if (!str)
+        str = find(reports, "std::string");
+    check(str != nullptr, "string optional should be reported");
+    if (str)
+    {
+        check(str->count(event::default_construct) == 2, "default");
+        check(str->count(event::in_place_construct) == 1, "in_place");
+        check(str->count(event::value_construct) == 1, "value");
+        check(str->count(event::copy_construct) == 1, "copy");
+        check(str->count(event::move_construct) == 1, "move");
+        check(str->count(event::copy_assign) == 1, "copy_assign");
+        check(str->count(event::move_assign) == 0, "move assign of empty should not count");
+        check(str->count(event::value_assign) == 1, "value_assign");
+        check(str->count(event::emplace) == 1, "emplace");
+        check(str->count(event::reset) == 1, "reset of empty should not count");
+        check(str->count(event::value_or_copy) == 1, "value_or_copy");
+        check(str->count(event::converting_construct) == 1, "converting");
+    }
+    const auto *scarce = find(reports, "Scarce");
+    check(scarce && scarce->count(event::in_place_construct) == 0 && scarce->count(event::copy_construct) == 1,
+          "event without memory should be dropped, later ones counted");
+    const auto *large = find(reports, "Large");
+    check(large && large->count(event::copy_construct) == 400, "copies from exited threads should be summed");
+    check(!reports.empty() && reports.front().type == "Large", "report should be sorted by copied bytes");
+    const auto *integer = find(reports, "int");
+    check(integer && integer->count(event::bad_access) == 1, "bad access should be counted");
+
+    std::ostringstream out;
+    pd::instrument::dump(out);
+    check(out.str().find("optional<Large> size=4096 copied_bytes=1638400") == 0, "dump should lead with costliest type");
+
+    pd::instrument::reset_counters();
+    check(pd::instrument::snapshot().front().copied_bytes() == 0, "reset_counters should zero everything");
+    return failed ? 1 : 0;
+}
@@ -1,8 +1,35 @@
 #include <iostream>
 #include <assert.h>
 #include <string>
+#include <climits>
+#include <cmath>
+#include <vector>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <random>
+#include <algorithm>
+#include <array>
+#include <memory_resource>
+#include <stdexcept>
 
 #include "../include/pd/optional.hh"
+#include "../include/pd/optional_vector.hh"
+#include "../include/pd/optional_kernels.hh"
+#include "../include/pd/atomic_optional.hh"
+#include "../include/pd/once_optional.hh"
+#include "../include/pd/lazy.hh"
+#include "../include/pd/optional_fields.hh"
+#include "../include/pd/sparse_optional_array.hh"
+#include "../include/pd/optional_io.hh"
+#include "../include/pd/parse_optional.hh"
+#include "../include/pd/flat_map.hh"
+#include "../include/pd/sort_optionals.hh"
+#include "../include/pd/allocator_optional.hh"
+#include "../include/pd/recycling_optional.hh"
+#include "../include/pd/boxed_optional.hh"
+#include "../include/pd/shared_optional.hh"
 
 void* print_testname(const char* name)
 {
@@ -71,6 +98,39 @@ bool is_failed = false;
         ~name() d;                                      \
     };
 
+// TYPE_MATRIX instantiates TYPE_GENERATOR for every combination of
+// defaulted, deleted and user provided special members (destructor can
+// only be defaulted or user provided) and calls check(type) for each
+#define TYPE_MATRIX(check)                              \
+    TYPE_MATRIX_MC(check, d, =default)                  \
+    TYPE_MATRIX_MC(check, x, =delete)                   \
+    TYPE_MATRIX_MC(check, u, {})
+
+#define TYPE_MATRIX_MC(check, n, cc)                    \
+    TYPE_MATRIX_CA(check, n##d, cc, =default)           \
+    TYPE_MATRIX_CA(check, n##x, cc, =delete)            \
+    TYPE_MATRIX_CA(check, n##u, cc, {})
+
+#define TYPE_MATRIX_CA(check, n, cc, mc)                \
+    TYPE_MATRIX_MA(check, n##d, cc, mc, =default)       \
+    TYPE_MATRIX_MA(check, n##x, cc, mc, =delete)        \
+    TYPE_MATRIX_MA(check, n##u, cc, mc, {return *this;})
+
+#define TYPE_MATRIX_MA(check, n, cc, mc, ca)            \
+    TYPE_MATRIX_D(check, n##d, cc, mc, ca, =default)    \
+    TYPE_MATRIX_D(check, n##x, cc, mc, ca, =delete)     \
+    TYPE_MATRIX_D(check, n##u, cc, mc, ca, {return *this;})
+
+#define TYPE_MATRIX_D(check, n, cc, mc, ca, ma)         \
+    TYPE_MATRIX_ENTRY(check, n##d, cc, mc, ca, ma, =default) \
+    TYPE_MATRIX_ENTRY(check, n##u, cc, mc, ca, ma, {})
+
+#define TYPE_MATRIX_ENTRY(check, n, cc, mc, ca, ma, d)  \
+    {                                                   \
+        TYPE_GENERATOR(matrix_##n, cc, mc, ca, ma, d);  \
+        check(matrix_##n);                              \
+    }
+
 TEST(testAssigment)
 {
     using namespace pd;
@@ -99,6 +159,123 @@ TEST(testAssigment)
     ASSERT(t2 != t1, "t2 shouldnt be equal to t1");
 }
 
+struct Tracked
+{
+    static int constructions, copies, moves, copy_assigns, move_assigns, destructions;
+
+    static void clear()
+    {
+        constructions = copies = moves = copy_assigns = move_assigns = destructions = 0;
+    }
+
+    Tracked(int v) : value(v) { ++constructions; }
+    Tracked(const Tracked &other) : value(other.value) { ++copies; }
+    Tracked(Tracked &&other) : value(other.value) { ++moves; }
+    Tracked& operator=(const Tracked &other) { value = other.value; ++copy_assigns; return *this; }
+    Tracked& operator=(Tracked &&other) { value = other.value; ++move_assigns; return *this; }
+    ~Tracked() { ++destructions; }
+
+    int value;
+};
+
+int Tracked::constructions, Tracked::copies, Tracked::moves,
+    Tracked::copy_assigns, Tracked::move_assigns, Tracked::destructions;
+
+TEST(testAssignmentTransitions)
+{
+    using namespace pd;
+    const optional<Tracked> engaged {in_place, 1};
+    const optional<Tracked> empty;
+
+    // copy assignment
+    {
+        optional<Tracked> lhs {in_place, 2};
+        Tracked::clear();
+        lhs = engaged;
+        ASSERT(lhs->value == 1, "engaged = engaged should copy value");
+        ASSERT(Tracked::copy_assigns == 1 && Tracked::copies == 0 && Tracked::destructions == 0,
+                "engaged = engaged should use T::operator=");
+
+        Tracked::clear();
+        lhs = empty;
+        ASSERT(!lhs && Tracked::destructions == 1, "engaged = empty should destroy value");
+
+        Tracked::clear();
+        lhs = empty;
+        ASSERT(!lhs && Tracked::destructions == 0, "empty = empty should do nothing");
+
+        Tracked::clear();
+        lhs = engaged;
+        ASSERT(lhs->value == 1 && Tracked::copies == 1 && Tracked::copy_assigns == 0,
+                "empty = engaged should copy construct");
+    }
+
+    // move assignment
+    {
+        optional<Tracked> lhs {in_place, 2};
+        optional<Tracked> rhs {in_place, 3};
+        Tracked::clear();
+        lhs = std::move(rhs);
+        ASSERT(lhs->value == 3 && rhs.has_value(), "engaged = engaged should move value");
+        ASSERT(Tracked::move_assigns == 1 && Tracked::moves == 0 && Tracked::destructions == 0,
+                "engaged = engaged should use T::operator=(T&&)");
+
+        optional<Tracked> none;
+        Tracked::clear();
+        lhs = std::move(none);
+        ASSERT(!lhs && Tracked::destructions == 1, "engaged = empty should destroy value");
+
+        Tracked::clear();
+        lhs = std::move(none);
+        ASSERT(!lhs && Tracked::destructions == 0, "empty = empty should do nothing");
+
+        Tracked::clear();
+        lhs = std::move(rhs);
+        ASSERT(lhs->value == 3 && Tracked::moves == 1 && Tracked::move_assigns == 0,
+                "empty = engaged should move construct");
+    }
+
+    // converting assignment
+    {
+        optional<Tracked> lhs {in_place, 2};
+        const optional<int> four {4};
+        const optional<int> none;
+        Tracked::clear();
+        lhs = four;
+        ASSERT(lhs->value == 4 && Tracked::destructions == 1 && Tracked::move_assigns == 1,
+                "engaged = optional<U> should assign temporary into existing value");
+
+        lhs = none;
+        ASSERT(!lhs, "engaged = empty optional<U> should reset");
+        lhs = none;
+        ASSERT(!lhs, "empty = empty optional<U> should stay empty");
+
+        Tracked::clear();
+        lhs = optional<int>(5);
+        ASSERT(lhs->value == 5 && Tracked::constructions == 1 && Tracked::move_assigns == 0,
+                "empty = optional<U>&& should construct from U");
+    }
+
+    // engaged to engaged assignment keeps buffers
+    {
+        optional<std::string> lhs {std::string(100, 'a')};
+        const optional<std::string> rhs {std::string(10, 'b')};
+        const char *buffer = lhs->data();
+        const std::size_t capacity = lhs->capacity();
+        lhs = rhs;
+        ASSERT(*lhs == *rhs, "lhs should be equal to rhs");
+        ASSERT(lhs->data() == buffer && lhs->capacity() == capacity,
+                "string should keep its buffer after engaged assignment");
+
+        optional<std::vector<int>> v {std::vector<int>(64, 1)};
+        const optional<std::vector<int>> small {std::vector<int>(16, 2)};
+        const int *data = v->data();
+        v = small;
+        ASSERT(*v == *small, "v should be equal to small");
+        ASSERT(v->data() == data, "vector should keep its buffer after engaged assignment");
+    }
+}
+
 TEST(testTriviality)
 {
     using namespace pd;
@@ -185,11 +362,1353 @@ TEST(testTypeProperties)
     REQUIRE(std::is_destructible_v<optional<copyType>>);
 }
 
+// pd::optional<T> must propagate triviality, availability and
+// noexcept of special members exactly like std::optional<T> does
+template<typename T>
+constexpr void checkMatchesStd()
+{
+    using pd_t = pd::optional<T>;
+    using std_t = std::optional<T>;
+    static_assert(std::is_copy_constructible_v<pd_t> == std::is_copy_constructible_v<std_t>);
+    static_assert(std::is_move_constructible_v<pd_t> == std::is_move_constructible_v<std_t>);
+    static_assert(std::is_copy_assignable_v<pd_t> == std::is_copy_assignable_v<std_t>);
+    static_assert(std::is_move_assignable_v<pd_t> == std::is_move_assignable_v<std_t>);
+    static_assert(std::is_trivially_copy_constructible_v<pd_t> ==
+                  std::is_trivially_copy_constructible_v<std_t>);
+    static_assert(std::is_trivially_move_constructible_v<pd_t> ==
+                  std::is_trivially_move_constructible_v<std_t>);
+    static_assert(std::is_trivially_copy_assignable_v<pd_t> ==
+                  std::is_trivially_copy_assignable_v<std_t>);
+    static_assert(std::is_trivially_move_assignable_v<pd_t> ==
+                  std::is_trivially_move_assignable_v<std_t>);
+    static_assert(std::is_trivially_destructible_v<pd_t> == std::is_trivially_destructible_v<std_t>);
+    static_assert(std::is_trivially_copyable_v<pd_t> == std::is_trivially_copyable_v<std_t>);
+    static_assert(std::is_nothrow_move_constructible_v<pd_t> ==
+                  std::is_nothrow_move_constructible_v<std_t>);
+    static_assert(std::is_nothrow_move_assignable_v<pd_t> ==
+                  std::is_nothrow_move_assignable_v<std_t>);
+    static_assert(pd::is_trivially_relocatable_v<pd_t> == pd::is_trivially_relocatable_v<T>);
+}
+
+#define CHECK_MATCHES_STD(type) checkMatchesStd<type>()
+
+TEST(testTrivialityMatrix)
+{
+    TYPE_MATRIX(CHECK_MATCHES_STD)
+    checkMatchesStd<int>();
+    checkMatchesStd<std::string>();
+    checkMatchesStd<std::vector<int>>();
+}
+
+struct Relocatable
+{
+    Relocatable(int v) : self(this), value(v) {}
+    Relocatable(Relocatable &&other) : self(this), value(other.value) {}
+    ~Relocatable() {}
+
+    Relocatable *self;
+    int value;
+};
+
+struct Counted
+{
+    Counted(int v) : value(new int(v)) {}
+    Counted(Counted &&other) noexcept : value(other.value) { other.value = nullptr; }
+    ~Counted() { delete value; }
+
+    int *value;
+};
+
+namespace pd
+{
+template<> struct is_trivially_relocatable<Counted> : std::true_type {};
+} // namespace pd
+
+TEST(testRelocation)
+{
+    using namespace pd;
+    REQUIRE(is_trivially_relocatable_v<optional<int>>);
+    REQUIRE(!is_trivially_relocatable_v<optional<Relocatable>>);
+    REQUIRE(is_trivially_relocatable_v<optional<Counted>>);
+
+    using int_opt = optional<int>;
+    alignas(int_opt) unsigned char raw[sizeof(int_opt) * 4];
+    int_opt *ints = reinterpret_cast<int_opt*>(raw);
+    new (ints) int_opt(1);
+    new (ints + 1) int_opt();
+    new (ints + 2) int_opt(3);
+    int_opt *end = relocate_n(ints, 3, ints + 1);
+    ASSERT(end == ints + 4, "relocate_n should return dst + n");
+    ASSERT(ints[1] == 1 && !ints[2] && ints[3] == 3, "overlapping trivial relocation should keep values");
+
+    using reloc_opt = optional<Relocatable>;
+    alignas(reloc_opt) unsigned char from[sizeof(reloc_opt) * 2];
+    alignas(reloc_opt) unsigned char to[sizeof(reloc_opt) * 2];
+    reloc_opt *src = reinterpret_cast<reloc_opt*>(from);
+    reloc_opt *dst = reinterpret_cast<reloc_opt*>(to);
+    new (src) reloc_opt(in_place, 7);
+    new (src + 1) reloc_opt();
+    relocate_n(src, 2, dst);
+    ASSERT(dst[0]->value == 7 && dst[0]->self == &*dst[0], "non trivial relocation should move construct");
+    ASSERT(!dst[1], "empty optional should stay empty");
+    dst[0].~reloc_opt();
+    dst[1].~reloc_opt();
+
+    using counted_opt = optional<Counted>;
+    alignas(counted_opt) unsigned char a[sizeof(counted_opt)], b[sizeof(counted_opt)];
+    counted_opt *ca = new (a) counted_opt(in_place, 5);
+    counted_opt *cb = relocate(ca, reinterpret_cast<counted_opt*>(b));
+    ASSERT(*(*cb)->value == 5, "relocated value should be kept");
+    cb->~counted_opt();
+}
+
+struct Big
+{
+    int id;
+    char payload[256];
+};
+
+TEST(testReferenceOptional)
+{
+    using namespace pd;
+    REQUIRE(sizeof(optional<Big&>) == sizeof(Big*));
+    REQUIRE(std::is_trivially_copyable_v<optional<Big&>>);
+    REQUIRE(std::is_trivially_destructible_v<optional<const Big&>>);
+    REQUIRE(!(std::is_constructible_v<optional<const int&>, int&&>));
+    REQUIRE(!(std::is_assignable_v<optional<const int&>&, int&&>));
+    REQUIRE((std::is_constructible_v<optional<const int&>, int&>));
+
+    Big a {1, {}};
+    Big b {2, {}};
+    optional<Big&> r;
+    ASSERT(!r && r == nullopt, "default optional<T&> should be empty");
+    ASSERT_THROW(r.value(), bad_optional_access, "value() of empty optional<T&> should throw");
+
+    r = a;
+    ASSERT(r && &*r == &a && r->id == 1, "r should refer to a");
+    r->id = 10;
+    ASSERT(a.id == 10, "modification through r should change a");
+
+    optional<Big&> r2 = r;
+    r2 = b;
+    ASSERT(&*r == &a && &*r2 == &b, "assignment should rebind, not assign through");
+    ASSERT(a.id == 10 && b.id == 2, "rebinding should not modify referred objects");
+
+    optional<const Big&> cr = r;
+    ASSERT(&*cr == &a, "optional<const T&> should be constructible from optional<T&>");
+    ASSERT(cr.value().id == 10, "value() should return referred object");
+
+    int x = 5;
+    optional<int&> ri = make_optional_ref(x);
+    optional<int&> ri2 = make_optional<int&>(x);
+    ASSERT(ri == 5 && ri == ri2 && ri2 >= 5, "comparisons should compare referred values");
+    ASSERT(ri.value_or(7) == 5, "value_or of engaged optional<T&> should return value");
+    ri.emplace(b.id);
+    ASSERT(ri == 2, "emplace should rebind");
+    ri.reset();
+    ASSERT(ri.value_or(7) == 7, "value_or of empty optional<T&> should return fallback");
+    ASSERT(ri < ri2 && ri != ri2, "empty optional<T&> should be less than engaged");
+
+    optional<int> copy = ri2;
+    x = 6;
+    ASSERT(copy == 5 && ri2 == 6, "optional<T> constructed from optional<T&> should hold a copy");
+
+    auto i = make_optional(x);
+    auto str = make_optional<std::string>(3, 'c');
+    auto vec = make_optional<std::vector<int>>({1, 2, 3});
+    static_assert(std::is_same_v<decltype(i), optional<int>>);
+    static_assert(std::is_same_v<decltype(make_optional_ref(std::as_const(x))), optional<const int&>>);
+    ASSERT(i == 6 && str == std::string("ccc") && vec->size() == 3, "make_optional should construct values");
+}
+
+struct Node { int payload; };
+enum class Color : unsigned char { red, green, invalid = 0xff };
+struct Sample { int value; };
+
+namespace pd
+{
+template<> struct optional_traits<Node*> : sentinel_traits<Node*, nullptr> {};
+template<> struct optional_traits<Color> : sentinel_traits<Color, Color::invalid> {};
+template<> struct optional_traits<long> : sentinel_traits<long, LONG_MIN> {};
+template<> struct optional_traits<double> : nan_traits<double> {};
+} // namespace pd
+
+TEST(testSentinelStorage)
+{
+    using namespace pd;
+    REQUIRE(sizeof(optional<Node*>) == sizeof(Node*));
+    REQUIRE(sizeof(optional<Color>) == sizeof(Color));
+    REQUIRE(sizeof(optional<long>) == sizeof(long));
+    REQUIRE(sizeof(optional<double>) == sizeof(double));
+    REQUIRE(sizeof(optional<Sample>) > sizeof(Sample));
+
+    REQUIRE(std::is_trivially_copyable_v<optional<Node*>>);
+    REQUIRE(std::is_trivially_copyable_v<optional<double>>);
+
+    Node n{42};
+    optional<Node*> p;
+    ASSERT(!p, "default constructed optional<Node*> should be empty");
+    p = &n;
+    ASSERT(p && (*p)->payload == 42, "p should hold &n");
+    p.reset();
+    ASSERT(p == nullopt, "p should be empty after reset");
+
+    optional<Color> c {Color::green};
+    optional<Color> c2 = c;
+    ASSERT(c2 == Color::green, "copy should keep the value");
+    c = nullopt;
+    ASSERT(!c && c2, "c should be empty, c2 engaged");
+
+    optional<long> l;
+    ASSERT(l.value_or(7) == 7, "empty optional<long> should return fallback");
+    l.emplace(-1);
+    ASSERT(l == -1L, "l should be equal to -1");
+
+    optional<double> d;
+    ASSERT(!d, "default constructed optional<double> should be empty");
+    d = std::numeric_limits<double>::quiet_NaN();
+    ASSERT(d.has_value(), "regular NaN should stay engaged");
+    d = 1.5;
+    ASSERT(d == 1.5, "d should be equal to 1.5");
+    d.reset();
+    ASSERT(!d, "d should be empty after reset");
+}
+
+TEST(testOptionalVector)
+{
+    using namespace pd;
+    optional_vector<int> v;
+    for (int i = 0; i < 130; ++i)
+    {
+        if (i % 3 == 0)
+            v.push_back(nullopt);
+        else
+            v.push_back(i);
+    }
+
+    ASSERT(v.size() == 130, "v should contain 130 elements");
+    ASSERT(v.validity_words() == 3, "130 elements should take 3 bitmap words");
+    ASSERT(v.count() == 86, "v should have 86 engaged elements");
+    ASSERT(!v[0] && !v[129], "multiples of 3 should be empty");
+    ASSERT(v[1] && *v[1] == 1, "v[1] should be equal to 1");
+    ASSERT(v[128].value_or(-1) == 128, "v[128] should be equal to 128");
+    ASSERT(v.values()[0] == 0, "empty slots should hold value initialized T");
+
+    v[0] = 5;
+    ASSERT(v[0].has_value() && *v[0] == 5, "v[0] should be equal to 5 after assignment");
+    v[1] = nullopt;
+    ASSERT(!v[1], "v[1] should be empty after nullopt assignment");
+    v.reset(2);
+    ASSERT(!v[2] && v.values()[2] == 0, "v[2] should be empty after reset");
+    v[3] = v[4];
+    ASSERT(*v[3] == 4, "v[3] should be equal to v[4]");
+
+    optional<int> o = v[4];
+    ASSERT(o == 4, "conversion to optional should keep the value");
+    o = v[6];
+    ASSERT(o == nullopt, "conversion of empty slot should give empty optional");
+
+    ASSERT_THROW(v[1].value(), bad_optional_access, "value() of empty slot should throw");
+
+    v.pop_back();
+    v.pop_back();
+    ASSERT(v.validity_words() == 2, "128 elements should take 2 bitmap words");
+
+    optional_vector<std::string> s {optional<std::string>("a"), nullopt};
+    s.emplace_back(3, 'b');
+    const auto &cs = s;
+    ASSERT(cs.size() == 3 && cs.count() == 2, "s should have 2 of 3 engaged");
+    ASSERT(*cs[2] == "bbb" && cs[2]->size() == 3, "s[2] should be equal to bbb");
+    s[1].emplace("c");
+    ASSERT(*cs[1] == "c", "s[1] should be equal to c after emplace");
+}
+
+template<typename T>
+void checkKernels(const pd::optional_vector<T> &col)
+{
+    using namespace pd;
+    const simd_level levels[] = {simd_level::sse2, simd_level::avx2, simd_level::avx512};
+    const T ref_sum = sum(col, simd_level::scalar);
+    const optional<T> ref_min = min(col, simd_level::scalar);
+    const optional<T> ref_max = max(col, simd_level::scalar);
+    const std::size_t ref_count = count_engaged(col, simd_level::scalar);
+
+    std::vector<T> ref_filled(col.size()), ref_compact(col.size());
+    fill_value_or(col, T(-1), ref_filled.data(), simd_level::scalar);
+    ref_compact.resize(compact(col, ref_compact.data(), simd_level::scalar));
+
+    for (simd_level level : levels)
+    {
+        ASSERT(sum(col, level) == ref_sum, "sum should match scalar kernel");
+        ASSERT(min(col, level) == ref_min, "min should match scalar kernel");
+        ASSERT(max(col, level) == ref_max, "max should match scalar kernel");
+        ASSERT(count_engaged(col, level) == ref_count, "count_engaged should match scalar kernel");
+
+        std::vector<T> filled(col.size()), compacted(col.size());
+        fill_value_or(col, T(-1), filled.data(), level);
+        compacted.resize(compact(col, compacted.data(), level));
+        ASSERT(filled == ref_filled, "fill_value_or should match scalar kernel");
+        ASSERT(compacted == ref_compact, "compact should match scalar kernel");
+    }
+}
+
+TEST(testColumnKernels)
+{
+    using namespace pd;
+    optional_vector<int> empty;
+    ASSERT(sum(empty) == 0, "sum of empty column should be 0");
+    ASSERT(min(empty) == nullopt && mean(empty) == nullopt, "min/mean of empty column should be empty");
+
+    optional_vector<int> small {1, nullopt, 3, nullopt, -5};
+    ASSERT(sum(small) == -1, "sum should skip empty slots");
+    ASSERT(min(small) == -5 && max(small) == 3, "min/max should skip empty slots");
+    ASSERT(count_engaged(small) == 3, "small should have 3 engaged elements");
+    ASSERT(mean(small) == -1.0 / 3, "mean should be computed over engaged elements");
+
+    optional_vector<int> ints;
+    optional_vector<std::int64_t> longs;
+    optional_vector<double> doubles;
+    optional_vector<std::uint8_t> bytes;
+    for (int i = 0; i < 1000; ++i)
+    {
+        // runs of fully engaged and fully empty words mixed with sparse ones
+        const bool engaged = (i / 64) % 3 == 0 || ((i / 64) % 3 == 1 && i % 7 == 0);
+        if (engaged)
+        {
+            ints.push_back(i * (i % 2 ? 1 : -1));
+            longs.push_back(std::int64_t(i) << 33);
+            doubles.push_back(i * 0.5);
+            bytes.push_back(static_cast<std::uint8_t>(i));
+        }
+        else
+        {
+            ints.push_back(nullopt);
+            longs.push_back(nullopt);
+            doubles.push_back(nullopt);
+            bytes.push_back(nullopt);
+        }
+    }
+    checkKernels(ints);
+    checkKernels(longs);
+    checkKernels(doubles);
+    checkKernels(bytes);
+
+    // infinities are ordinary values, NaN propagates; columns span
+    // several words so that vector paths and scalar tail are both hit
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const simd_level all_levels[] = {simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512};
+    for (std::size_t at : {std::size_t(0), std::size_t(70), std::size_t(199)})
+    {
+        optional_vector<double> pos_inf(200), neg_inf(200), nans(200);
+        pos_inf[at] = inf;
+        neg_inf[at] = -inf;
+        nans[at] = nan;
+        nans[at / 2 + 1] = 1.0;
+        for (simd_level level : all_levels)
+        {
+            ASSERT(min(pos_inf, level) == inf && max(pos_inf, level) == inf, "min/max of {+inf} should be +inf");
+            ASSERT(min(neg_inf, level) == -inf && max(neg_inf, level) == -inf, "min/max of {-inf} should be -inf");
+            ASSERT(min(nans, level) && std::isnan(*min(nans, level)), "min should propagate NaN");
+            ASSERT(max(nans, level) && std::isnan(*max(nans, level)), "max should propagate NaN");
+        }
+    }
+}
+
+// neither copyable nor movable, so it can only be returned
+// through guaranteed copy elision
+struct Pinned
+{
+    explicit Pinned(int v) : value(v) {}
+    Pinned(const Pinned&) = delete;
+    Pinned& operator= (const Pinned&) = delete;
+    int value;
+};
+
+TEST(testMonadic)
+{
+    using namespace pd;
+    auto half = [](int v) { return v % 2 ? optional<int>() : optional<int>(v / 2); };
+    auto twice = [](int v) { return v * 2; };
+
+    optional<int> eight = 8;
+    optional<int> seven = 7;
+    optional<int> none;
+    ASSERT(eight.and_then(half).and_then(half) == 2, "and_then should chain engaged values");
+    ASSERT(!seven.and_then(half), "and_then should propagate empty result of f");
+    ASSERT(!none.and_then(half), "and_then of empty optional should be empty");
+    ASSERT(eight.transform(twice) == 16 && !none.transform(twice), "transform should map value");
+    ASSERT(eight.or_else([] { return optional<int>(1); }) == 8, "or_else should keep value");
+    ASSERT(none.or_else([] { return optional<int>(1); }) == 1, "or_else should call f when empty");
+
+    int calls = 0;
+    auto fallback = [&calls] { ++calls; return 42; };
+    ASSERT(eight.value_or_else(fallback) == 8 && calls == 0, "value_or_else should not call f when engaged");
+    ASSERT(none.value_or_else(fallback) == 42 && calls == 1, "value_or_else should call f when empty");
+
+    auto pinned = eight.transform([](int v) { return Pinned(v); });
+    static_assert(std::is_same_v<decltype(pinned), optional<Pinned>>);
+    ASSERT(pinned && pinned->value == 8, "transform should construct non-movable result in place");
+
+    // rvalue overloads move the value out
+    optional<std::string> s = std::string(32, 'x');
+    auto len = std::move(s).transform([](std::string &&str) { std::string taken = std::move(str); return taken.size(); });
+    ASSERT(len == 32u && s->empty(), "rvalue transform should pass value as rvalue");
+    s = std::string("abc");
+    auto moved = std::move(s).and_then([](std::string &&str) { return pd::make_optional(std::move(str)); });
+    ASSERT(moved == std::string("abc") && s->empty(), "rvalue and_then should pass value as rvalue");
+    s = std::string("def");
+    std::string taken = std::move(s).value_or_else([] { return std::string(); });
+    ASSERT(taken == "def" && s->empty(), "rvalue value_or_else should move value out");
+
+    const optional<int> c = 3;
+    auto plus_half = c.transform([](const int &v) { return v + 0.5; });
+    auto same = std::move(c).transform([](const int &&v) { return v; });
+    static_assert(std::is_same_v<decltype(plus_half), optional<double>>);
+    static_assert(std::is_same_v<decltype(same), optional<int>>);
+    ASSERT(plus_half == 3.5 && same == 3, "const transform should work");
+    ASSERT(c.and_then([](const int &v) { return optional<long>(v); }) == 3L, "const and_then should work");
+
+    int x = 4;
+    optional<int&> r = x;
+    r.transform([](int &v) { return v += 1; });
+    ASSERT(x == 5, "transform on optional<T&> should pass referred object");
+    ASSERT(r.and_then(half) == nullopt && optional<int&>().value_or_else([] { return 1; }) == 1,
+           "monadic operations on optional<T&> should work");
+}
+
+struct Padded { char tag; int value; };
+struct Ticket { int id; int producer; int payload; };
+
+TEST(testAtomicOptional)
+{
+    using namespace pd;
+    REQUIRE(atomic_optional<int>::is_always_lock_free);
+    REQUIRE(atomic_optional<Node*>::is_always_lock_free);
+    REQUIRE(atomic_optional<Ticket>::is_always_lock_free);
+
+    atomic_optional<int> a;
+    ASSERT(!a.has_value() && !a.load(), "default atomic_optional should be empty");
+    a.store(5);
+    ASSERT(a.load() == 5, "store should publish value");
+    ASSERT(a.exchange(6) == 5 && a.load() == 6, "exchange should return previous value");
+    ASSERT(!a.emplace_if_empty(7) && a.load() == 6, "emplace_if_empty should not overwrite value");
+    ASSERT(a.take() == 6 && !a.has_value(), "take should leave atomic_optional empty");
+    ASSERT(a.emplace_if_empty(0) && a.load() == 0, "emplace_if_empty should fill empty slot");
+
+    optional<int> expected = 1;
+    ASSERT(!a.compare_exchange_strong(expected, 2) && expected == 0,
+           "failed compare_exchange should report current value");
+    ASSERT(a.compare_exchange_strong(expected, nullopt) && !a.has_value(),
+           "compare_exchange should succeed on matching value");
+    expected = nullopt;
+    while (!a.compare_exchange_weak(expected, 3)) {}
+    ASSERT(a.load() == 3, "compare_exchange_weak should store desired value");
+
+#if PD_OPTIONAL_HAS_CLEAR_PADDING
+    // padding bytes must not make equal values compare different
+    Padded p;
+    std::memset(&p, 0xab, sizeof(p));
+    p.tag = 'x';
+    p.value = 1;
+    atomic_optional<Padded> ap(p);
+    optional<Padded> ep = Padded{'x', 1};
+    ASSERT(ap.compare_exchange_strong(ep, nullopt), "padding should not affect compare_exchange");
+#endif
+
+    Node n {1};
+    atomic_optional<Node*> an(&n);
+    ASSERT(an.take() == &n && !an.has_value(), "sentinel atomic_optional should hand off pointer");
+
+    // wide values hand off between threads through 16 byte word
+    atomic_optional<Ticket> slot;
+    constexpr int items = 10000;
+    long received = 0;
+    std::thread consumer([&]
+    {
+        for (int got = 0; got < items;)
+            if (auto item = slot.take())
+            {
+                received += item->id + item->payload;
+                ++got;
+            }
+            else
+                std::this_thread::yield();
+    });
+    for (int i = 0; i < items;)
+        if (slot.emplace_if_empty({i, 0, 1}))
+            ++i;
+        else
+            std::this_thread::yield();
+    consumer.join();
+    ASSERT(received == long(items) * (items - 1) / 2 + items, "every value should be received exactly once");
+}
+
+TEST(testOnceOptional)
+{
+    using namespace pd;
+    static_assert(sizeof(once_optional<std::uint64_t>) == 2 * sizeof(std::uint64_t),
+            "state should be the only flag of once_optional");
+    once_optional<std::string> name;
+    ASSERT(!name.has_value() && !name.get(), "once_optional should start empty");
+    ASSERT_THROW(name.get_or_init([]() -> std::string { throw 1; }), int, "exception from f should propagate");
+    ASSERT(!name.has_value(), "failed initialization should leave cell empty");
+    ASSERT(name.get_or_init([] { return std::string("first"); }) == "first", "get_or_init should store result of f");
+    ASSERT(name.get_or_init([] { return std::string("second"); }) == "first", "f should be called only once");
+    ASSERT(name.get() == std::string("first"), "get should return stored value");
+
+    // non-movable result is constructed in place
+    once_optional<Pinned> pinned;
+    ASSERT(pinned.get_or_init([] { return Pinned(3); }).value == 3, "get_or_init should construct in place");
+
+    once_optional<std::vector<int>> table;
+    std::atomic<int> calls {0};
+    std::atomic<long> sum {0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t)
+        readers.emplace_back([&]
+        {
+            const auto &v = table.get_or_init([&]
+            {
+                ++calls;
+                std::this_thread::yield();
+                return std::vector<int>(100, 1);
+            });
+            sum += static_cast<long>(v.size());
+        });
+    for (auto &r : readers)
+        r.join();
+    ASSERT(calls == 1 && sum == 400, "racing initializers should run f exactly once");
+}
+
+TEST(testLazy)
+{
+    using namespace pd;
+    auto payload = std::make_shared<int>(7);
+    int calls = 0;
+    auto l = make_lazy([payload, &calls] { ++calls; return std::string(size_t(*payload), 'x'); });
+    static_assert(std::is_same_v<decltype(l)::value_type, std::string>);
+    static_assert(sizeof(lazy<std::uint64_t>) == 2 * sizeof(std::uint64_t) + sizeof(std::uint64_t(*)()),
+            "lazy should be value, callable and state, nothing else");
+    ASSERT(!l.has_value() && calls == 0 && payload.use_count() == 2, "lazy should not evaluate on construction");
+    ASSERT(l->size() == 7 && *l == "xxxxxxx" && calls == 1, "first access should evaluate");
+    ASSERT(l.get() == "xxxxxxx" && calls == 1, "value should be memoized");
+    ASSERT(payload.use_count() == 1, "callable should be destroyed after evaluation");
+
+    auto moved = std::move(l);
+    ASSERT(moved.has_value() && *moved == "xxxxxxx" && calls == 1, "moved lazy should keep evaluated value");
+
+    int attempts = 0;
+    lazy<int, std::function<int()>> flaky([&attempts] { if (attempts++ == 0) throw 1; return 5; });
+    ASSERT_THROW(flaky.get(), int, "exception from callable should propagate");
+    ASSERT(!flaky.has_value() && flaky.get() == 5 && attempts == 2, "failed evaluation should be retried");
+
+    auto pinned = make_lazy([] { return Pinned(9); });
+    ASSERT(pinned->value == 9, "lazy should construct non-movable value in place");
+
+    std::atomic<int> shared_calls {0};
+    auto shared = make_sync_lazy([&shared_calls] { ++shared_calls; std::this_thread::yield(); return 11; });
+    std::atomic<int> sum {0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t)
+        readers.emplace_back([&] { sum += *shared; });
+    for (auto &r : readers)
+        r.join();
+    ASSERT(shared_calls == 1 && sum == 44, "sync_lazy should evaluate exactly once");
+}
+
+TEST(testOptionalFields)
+{
+    using namespace pd;
+    using message = optional_fields<char, double, std::int32_t, std::int16_t, std::int32_t>;
+    REQUIRE(sizeof(message) <= 32);
+    REQUIRE(std::is_trivially_copyable_v<message>);
+    REQUIRE((std::is_same_v<message::mask_type, std::uint8_t>));
+
+    message m;
+    ASSERT(!m.any() && m.count() == 0 && !m.has<1>() && !m.get<1>(), "fields should start empty");
+    m.emplace<1>(2.5);
+    m.emplace<4>(7);
+    ASSERT(m.has<1>() && m.get<1>() == 2.5 && m.get<4>() == 7, "emplace should set field");
+    ASSERT(m.count() == 2 && m.mask() == 0b10010, "count and mask should reflect set fields");
+    ASSERT(m.count(message::mask_of<0, 1, 2>()) == 1, "count should respect selection");
+    *m.get<4>() += 1;
+    ASSERT(m.value_or<4>(0) == 8 && m.value_or<2>(-1) == -1, "get should give access to stored value");
+
+    message copy = m;
+    m.reset<1>();
+    ASSERT(!m.has<1>() && copy.get<1>() == 2.5 && copy.count() == 2, "copy should be independent");
+    m.reset();
+    ASSERT(!m.any(), "reset should clear all fields");
+
+    using wide = optional_fields<std::string, int, std::vector<int>>;
+    REQUIRE(!std::is_trivially_copyable_v<wide>);
+    Tracked::clear();
+    {
+        optional_fields<Tracked, std::string> t;
+        t.emplace<0>(1);
+        t.emplace<1>(40, 's');
+        auto t2 = t;
+        auto t3 = std::move(t2);
+        t3.emplace<0>(2);
+        ASSERT(t3.get<1>()->size() == 40 && !t2.get<1>()->size(), "non-trivial fields should be copied and moved");
+    }
+    ASSERT(Tracked::constructions + Tracked::copies + Tracked::moves == Tracked::destructions,
+           "every constructed field should be destroyed");
+    wide w;
+    w.emplace<2>(std::vector<int>{1, 2, 3});
+    wide w2;
+    w2 = w;
+    ASSERT(w2.get<2>()->size() == 3 && !w2.has<0>() && w2.all() == false, "copy assignment should copy fields");
+}
+
+TEST(testSparseOptionalArray)
+{
+    using namespace pd;
+    sparse_optional_array<int> empty;
+    ASSERT(empty.begin() == empty.end() && empty.count() == 0, "default array should be empty");
+
+    std::vector<optional<int>> dense(2000);
+    for (size_t i = 0; i < dense.size(); ++i)
+        if (i % 7 == 3 || (i > 600 && i < 700))
+            dense[i] = static_cast<int>(i);
+    sparse_optional_array<int> sparse(dense.begin(), dense.end());
+    ASSERT(sparse.size() == dense.size() && sparse.count() == 371u, "array should keep only engaged values");
+
+    bool same = true;
+    size_t engaged = 0;
+    for (size_t i = 0; i < dense.size(); ++i)
+    {
+        same = same && sparse[i] == dense[i] && sparse.rank(i) == engaged;
+        if (dense[i])
+            same = same && sparse.select(engaged++) == i;
+    }
+    ASSERT(same, "lookup, rank and select should agree with dense vector");
+
+    size_t visited = 0;
+    same = true;
+    for (auto [index, value] : sparse)
+    {
+        same = same && dense[index] == value;
+        ++visited;
+    }
+    ASSERT(same && visited == sparse.count(), "iteration should visit every engaged entry in order");
+
+    sparse.set(5, -5);
+    sparse.set(3, -3);
+    sparse.reset(10);
+    sparse.reset(11);
+    dense[5] = -5;
+    dense[3] = -3;
+    dense[10].reset();
+    same = true;
+    for (size_t i = 0; i < dense.size(); ++i)
+        same = same && sparse[i] == dense[i];
+    ASSERT(same && sparse.select(sparse.count() - 1) == 1998, "set and reset should keep index consistent");
+
+    sparse.resize(650);
+    dense.resize(650);
+    sparse.resize(900);
+    dense.resize(900);
+    sparse.push_back(7);
+    dense.push_back(7);
+    same = sparse.size() == dense.size();
+    for (size_t i = 0; i < dense.size(); ++i)
+        same = same && sparse[i] == dense[i];
+    ASSERT(same, "resize should drop and append entries");
+
+    sparse_optional_array<std::string> strings {std::string("a"), nullopt, std::string("c")};
+    ASSERT(strings[0] == std::string("a") && !strings[1] && strings[2]->size() == 1,
+           "array should hold non-trivial values");
+}
+
+TEST(testColumnFile)
+{
+    using namespace pd;
+    const std::string path = "optional_io_test.bin";
+    optional_vector<std::int64_t> source;
+    for (int i = 0; i < 150; ++i)
+        if (i % 3)
+            source.push_back(i * 10);
+        else
+            source.push_back(nullopt);
+    {
+        column_writer<std::int64_t> writer(path);
+        writer.push_back(optional<std::int64_t>(-1));
+        writer.push_back(nullopt);
+        writer.append(source);
+        writer.push_back(7);
+        writer.finish();
+    }
+
+    mapped_column<std::int64_t> column(path);
+    ASSERT(column.size() == 153 && column.count() == 102, "header should record size and engaged count");
+    ASSERT(column[0] == -1 && !column[1] && column[152] == 7, "values written one by one should read back");
+    bool same = true;
+    for (size_t i = 0; i < source.size(); ++i)
+        same = same && column[i + 2] == optional<std::int64_t>(source[i]);
+    ASSERT(same, "appended column should read back");
+    ASSERT(reinterpret_cast<std::uintptr_t>(column.values()) % 64 == 0, "payload should be aligned");
+
+    ASSERT_THROW(mapped_column<double>{path}, format_error, "reading with another type should fail");
+    {
+        column_writer<int> unfinished(path);
+        unfinished.push_back(1);
+    }
+    ASSERT_THROW(mapped_column<int>{path}, format_error, "unfinished file should be rejected");
+    ASSERT_THROW(mapped_column<int>("missing_optional_io_test.bin"), std::system_error, "missing file should fail");
+
+    {
+        column_writer<float> scalar(path);
+        scalar.push_back(optional<float>(2.5f));
+        scalar.finish();
+    }
+    ASSERT(mapped_column<float>(path)[0] == 2.5f, "scalar should be stored as column of one");
+    std::remove(path.c_str());
+}
+
+TEST(testParseOptional)
+{
+    using namespace pd;
+    parse_status status;
+    ASSERT(parse_optional<int>("42") == 42, "integer should parse");
+    ASSERT(parse_optional<int>(" +7\r") == 7, "blanks and plus sign should be accepted");
+    ASSERT(parse_optional<std::int64_t>("-9000000000") == -9000000000LL, "negative 64 bit should parse");
+    ASSERT(parse_optional<double>("2.5e3") == 2500.0, "float should parse");
+    ASSERT(!parse_optional<int>("NULL", status) && status == parse_status::null, "null token should be absent");
+    ASSERT(!parse_optional<int>("", status) && status == parse_status::null, "empty field should be absent");
+    ASSERT(!parse_optional<int>("12x", status) && status == parse_status::invalid, "trailing junk should be invalid");
+    ASSERT(!parse_optional<int>("+-1", status) && status == parse_status::invalid, "double sign should be invalid");
+    ASSERT(!parse_optional<std::uint8_t>("300", status) && status == parse_status::invalid, "overflow should be invalid");
+
+    parse_options options;
+    options.null_tokens = {"-"};
+    ASSERT(!parse_optional<int>("-", status, options) && status == parse_status::null, "custom null token");
+    ASSERT(!parse_optional<int>("NA", status, options) && status == parse_status::invalid, "default tokens replaced");
+
+    // long enough for several 64 byte blocks and a scalar tail
+    std::string column;
+    std::vector<optional<int>> expected;
+    for (int i = 0; i < 300; ++i)
+    {
+        if (i % 7 == 0)
+        {
+            column += i % 2 ? "NA" : "";
+            expected.push_back(nullopt);
+        }
+        else
+        {
+            column += std::to_string(i * 31 - 500);
+            expected.push_back(i * 31 - 500);
+        }
+        column += '\n';
+    }
+    column += "bad\n";
+    expected.push_back(nullopt);
+    for (simd_level level : {simd_level::scalar, simd_level::sse2, simd_level::avx2, simd_level::avx512})
+    {
+        optional_vector<int> out;
+        const parse_stats stats = parse_column(column, '\n', out, default_parse_options(), level);
+        bool same = out.size() == expected.size();
+        for (size_t i = 0; same && i < out.size(); ++i)
+            same = optional<int>(out[i]) == expected[i];
+        ASSERT(same, "batch parse should match scalar parse at every simd level");
+        ASSERT(stats.values == 257 && stats.nulls == 43 && stats.invalid == 1, "batch stats");
+    }
+
+    const std::string csv = "id,price,qty\n1,2.5,3\n2,,4\n3,NULL,5\n4\n5,x,6\n";
+    optional_vector<double> prices;
+    const parse_stats stats = parse_field(csv, 1, ',', '\n', prices);
+    ASSERT(prices.size() == 6 && !prices[0] && *prices[1] == 2.5 && !prices[2] && !prices[3] && !prices[4] && !prices[5],
+            "field should be picked from every record");
+    ASSERT(stats.values == 1 && stats.nulls == 2 && stats.invalid == 3, "header, short record and junk are invalid");
+
+    // trailing separators must not drop the field or record after them
+    optional_vector<int> trailing;
+    parse_column("1,,", ',', trailing);
+    ASSERT(trailing.size() == 3 && *trailing[0] == 1 && !trailing[1] && !trailing[2], "trailing delimiter ends with empty field");
+    optional_vector<int> open_record;
+    parse_field("1,2\n3,", 1, ',', '\n', open_record);
+    ASSERT(open_record.size() == 2 && *open_record[0] == 2 && !open_record[1], "record open at end of text should be flushed");
+    optional_vector<int> closed_record;
+    parse_field("1,2\n3,4\n", 1, ',', '\n', closed_record);
+    ASSERT(closed_record.size() == 2 && *closed_record[1] == 4, "final record_sep should not start another record");
+}
+
+TEST(testHashAndFlatMap)
+{
+    using namespace pd;
+    std::hash<optional<int>> h;
+    ASSERT(h(optional<int>(5)) == std::hash<int>()(5), "engaged hash should be value hash");
+    ASSERT(h(optional<int>()) == h(nullopt), "empty optionals should hash alike");
+    std::unordered_set<optional<std::string>> keys {optional<std::string>("a"), nullopt};
+    ASSERT(keys.count(optional<std::string>("a")) == 1 && keys.count(nullopt) == 1 && keys.size() == 2,
+            "optional should key unordered containers");
+    ASSERT(!std::is_default_constructible<std::hash<optional<Pinned>>>::value,
+            "hash of optional of unhashable type should be disabled");
+
+    flat_map<std::string, int> names {{"one", 1}, {"two", 2}};
+    ASSERT(names.size() == 2 && names.at("two") == 2 && !names.contains("three"), "initializer list");
+    names["three"] = 3;
+    ASSERT(!names.insert({"one", 10}).second && names["one"] == 1, "insert should not overwrite");
+    names.insert_or_assign("one", 11);
+    ASSERT(names["one"] == 11, "insert_or_assign should overwrite");
+    ASSERT_THROW(names.at("four"), std::out_of_range, "at of missing key should throw");
+    ASSERT(names.erase("two") == 1 && names.erase("two") == 0 && names.size() == 2, "erase by key");
+
+    // at the load limit, lookups of present keys must not rehash
+    flat_map<int, int> full;
+    for (int i = 0; i < 12; ++i)
+        full[i] = i;
+    const std::size_t buckets = full.bucket_count();
+    int *first = &full[0];
+    full[5] = 50;
+    full.insert({6, 60});
+    full.emplace(7, 70);
+    ASSERT(full.bucket_count() == buckets && &full[0] == first && full[6] == 6,
+            "present key should not grow the table");
+    full[12] = 12;
+    ASSERT(full.bucket_count() == 2 * buckets && full.size() == 13 && full[12] == 12 && full[5] == 50,
+            "absent key should grow and still land");
+
+    // random churn against std::unordered_map, small key range keeps
+    // long clusters so backward shift is exercised across wraparound
+    flat_map<std::uint32_t, std::uint32_t> map;
+    std::unordered_map<std::uint32_t, std::uint32_t> reference;
+    std::mt19937 gen(17);
+    bool same = true;
+    for (int i = 0; i < 20000; ++i)
+    {
+        const std::uint32_t key = gen() % 700;
+        switch (gen() % 3)
+        {
+        case 0:
+            map[key] = static_cast<std::uint32_t>(i);
+            reference[key] = static_cast<std::uint32_t>(i);
+            break;
+        case 1:
+            same = same && map.erase(key) == reference.erase(key);
+            break;
+        default:
+            same = same && map.contains(key) == (reference.count(key) == 1);
+            break;
+        }
+    }
+    ASSERT(same && map.size() == reference.size(), "flat_map should agree with unordered_map");
+    std::size_t visited = 0;
+    for (const auto &[key, value] : map)
+        same = same && reference.at(key) == value && ++visited;
+    ASSERT(same && visited == reference.size(), "iteration should visit every entry once");
+    ASSERT(map.load_factor() <= 0.75f, "load factor should stay bounded");
+    map.erase(map.find(reference.begin()->first));
+    ASSERT(map.size() + 1 == reference.size(), "erase by iterator");
+    map.clear();
+    ASSERT(map.empty() && map.begin() == map.end(), "clear");
+}
+
+TEST(testSwap)
+{
+    using namespace pd;
+    {
+        optional<Tracked> a {in_place, 1}, b {in_place, 2};
+        Tracked::clear();
+        swap(a, b);
+        ASSERT(a->value == 2 && b->value == 1, "engaged with engaged should swap values");
+        ASSERT(Tracked::moves == 1 && Tracked::move_assigns == 2 && Tracked::destructions == 1,
+                "engaged with engaged should use swap of T");
+    }
+    {
+        optional<Tracked> a {in_place, 1}, b;
+        Tracked::clear();
+        a.swap(b);
+        ASSERT(!a && b->value == 1, "engaged with empty should move value across");
+        ASSERT(Tracked::moves == 1 && Tracked::move_assigns == 0 && Tracked::destructions == 1,
+                "engaged with empty should move once and destroy source");
+        Tracked::clear();
+        a.swap(b);
+        ASSERT(a->value == 1 && !b && Tracked::moves == 1, "empty with engaged should move value back");
+        optional<Tracked> c, d;
+        Tracked::clear();
+        c.swap(d);
+        ASSERT(!c && !d && Tracked::moves == 0 && Tracked::destructions == 0, "empty with empty is no op");
+    }
+
+    optional<int> x = 5, y;
+    swap(x, y);
+    ASSERT(!x && y == 5, "trivial swap should move engagement");
+    optional<double> sentinel = 1.5, nan;
+    sentinel.swap(nan);
+    ASSERT(!sentinel && nan == 1.5, "sentinel swap");
+    static_assert(noexcept(x.swap(y)), "trivial swap should be noexcept");
+    static_assert(!noexcept(std::declval<optional<Tracked>&>().swap(std::declval<optional<Tracked>&>())),
+            "throwing move should make swap throwing");
+
+    int i = 1, j = 2;
+    optional<int&> ri = i, rj = j;
+    swap(ri, rj);
+    ASSERT(&*ri == &j && &*rj == &i && i == 1 && j == 2, "reference swap should rebind only");
+
+    std::vector<optional<std::string>> words {"pear", nullopt, "apple", "fig", nullopt, "banana"};
+    std::sort(words.begin(), words.end());
+    ASSERT(!words[0] && !words[1] && words[2] == "apple" && words[3] == "banana" && words[4] == "fig"
+            && words[5] == "pear", "std::sort should order optionals, empty first");
+    ASSERT(std::is_swappable<optional<std::string>>::value && !std::is_swappable<optional<Pinned>>::value,
+            "swappable as T is");
+}
+
+TEST(testSortOptionals)
+{
+    using namespace pd;
+    std::mt19937_64 gen(19);
+    auto expect_sorted = [](const auto &v, null_order order)
+    {
+        auto less = [order](const auto &a, const auto &b)
+        {
+            if (a && b)
+                return *a < *b;
+            return order == nulls_first ? b.has_value() : a.has_value();
+        };
+        return std::is_sorted(v.begin(), v.end(), less);
+    };
+
+    for (std::size_t n : {10, 5000})
+    {
+        std::vector<optional<std::int64_t>> ints;
+        std::vector<optional<double>> doubles;
+        std::vector<optional<std::uint16_t>> shorts;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const bool empty = gen() % 8 == 0;
+            ints.push_back(empty ? optional<std::int64_t>() : static_cast<std::int64_t>(gen()));
+            doubles.push_back(empty ? optional<double>() : (static_cast<double>(gen() % 2001) - 1000.0) / 8);
+            shorts.push_back(empty ? optional<std::uint16_t>() : static_cast<std::uint16_t>(gen() % 300));
+        }
+        auto sorted_ints = ints;
+        std::sort(sorted_ints.begin(), sorted_ints.end());
+        sort_optionals(ints.begin(), ints.end());
+        ASSERT(ints == sorted_ints, "radix sort should match std::sort with nulls first");
+        sort_optionals(doubles.begin(), doubles.end(), nulls_last);
+        ASSERT(expect_sorted(doubles, nulls_last) && !doubles.back() && (n < 100 || doubles.front()),
+                "doubles should sort with nulls last");
+        stable_sort_optionals(shorts.begin(), shorts.end(), nulls_last);
+        ASSERT(expect_sorted(shorts, nulls_last), "narrow keys should sort");
+    }
+
+    std::vector<optional<double>> zeros(300, 1.0);
+    zeros[10] = -0.0;
+    zeros[20] = 0.0;
+    zeros[30] = -0.0;
+    zeros[40] = -1e300;
+    zeros[50] = nullopt;
+    stable_sort_optionals(zeros.begin(), zeros.end());
+    ASSERT(!zeros[0] && zeros[1] == -1e300 && std::signbit(*zeros[2]) && !std::signbit(*zeros[3])
+            && std::signbit(*zeros[4]) && zeros[5] == 1.0, "stable sort should keep -0.0 and 0.0 in input order");
+
+    // NaNs go past infinities on their side below and above radix threshold
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (std::size_t ones : {std::size_t(0), std::size_t(300)})
+    {
+        std::vector<optional<double>> odd {nan, 1.0, -inf, -nan, inf, nullopt, 0.0, nan};
+        odd.insert(odd.end(), ones, 1.0);
+        sort_optionals(odd.begin(), odd.end());
+        const std::size_t tail = odd.size() - 3;
+        ASSERT(!odd[0] && std::isnan(*odd[1]) && std::signbit(*odd[1]) && odd[2] == -inf && odd[3] == 0.0
+                && odd[tail] == inf && std::isnan(*odd[tail + 1]) && std::isnan(*odd[tail + 2]),
+                "NaNs should be ordered the same by both sort paths");
+    }
+
+    std::vector<optional<std::string>> words {"b", nullopt, "a", "c"};
+    sort_optionals(words.begin(), words.end(), nulls_last);
+    ASSERT(words[0] == "a" && words[1] == "b" && words[2] == "c" && !words[3], "fallback should honour null order");
+}
+
+// hex digit decode table built in constant evaluation
+constexpr std::array<pd::optional<int>, 128> make_hex_table()
+{
+    std::array<pd::optional<int>, 128> table {};
+    for (int c = '0'; c <= '9'; ++c)
+        table[c].emplace(c - '0');
+    for (int c = 'a'; c <= 'f'; ++c)
+    {
+        table[c] = c - 'a' + 10;
+        table[c - 'a' + 'A'] = table[c];
+    }
+    table['x'] = 1;
+    table['x'] = pd::nullopt;
+    table['y'].emplace(2);
+    table['y'].reset();
+    return table;
+}
+
+constexpr pd::optional<long> constexpr_conversions()
+{
+    pd::optional<int> a = 3, b;
+    a.swap(b);
+    pd::optional<long> widened = b;
+    pd::optional<long> moved = std::move(b);
+    return *widened + *moved;
+}
+
+TEST(testConstexpr)
+{
+    constexpr auto table = make_hex_table();
+    static_assert(table['7'] == 7 && table['c'] == 12 && table['C'] == 12, "table should hold digits");
+    static_assert(!table['g'] && !table['x'] && !table['y'], "assigning nullopt and reset should clear");
+    static_assert(constexpr_conversions() == 6L, "converting constructors and swap should be constexpr");
+    ASSERT(table['f'] == 15, "constexpr table should be usable at run time");
+}
+
+// memory_resource which counts what passes through it
+struct counting_resource : std::pmr::memory_resource
+{
+    std::size_t allocations = 0;
+    std::size_t deallocations = 0;
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+    {
+        ++deallocations;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+TEST(testAllocatorOptional)
+{
+    counting_resource fallback;
+    counting_resource arena;
+    std::pmr::memory_resource *const elsewhere = std::pmr::new_delete_resource();
+    std::pmr::memory_resource *const previous = std::pmr::set_default_resource(&fallback);
+    const char *const text = "long enough to never fit into small string buffer";
+
+    {
+        std::pmr::string source(text, &arena);
+        pd::optional<std::pmr::string> plain;
+        plain = source;
+        ASSERT(fallback.allocations == 1 && plain->get_allocator().resource() == &fallback,
+               "plain optional has no arena to copy into");
+    }
+    fallback.allocations = 0;
+    arena.allocations = arena.deallocations = 0;
+
+    using pmr_string = pd::pmr::optional<std::pmr::string>;
+    static_assert(std::uses_allocator<pmr_string, std::pmr::polymorphic_allocator<pmr_string>>::value,
+            "pmr optional should be uses-allocator constructible");
+    {
+        pmr_string a(std::allocator_arg, &arena);
+        REQUIRE(!a && a.get_allocator().resource() == &arena);
+        a.emplace(text);
+        REQUIRE(a->get_allocator().resource() == &arena && arena.allocations == 1);
+
+        std::pmr::string foreign(text, elsewhere);
+        a.reset();
+        a = foreign;
+        ASSERT(a->get_allocator().resource() == &arena && arena.allocations == 2,
+               "empty target should build value with its own allocator");
+        a = std::move(foreign);
+        ASSERT(a->get_allocator().resource() == &arena, "engaged target should keep its allocator");
+
+        pmr_string b(std::allocator_arg, &arena, a);
+        REQUIRE(b.get_allocator().resource() == &arena && b == a && *b == text);
+        const std::size_t before_move = arena.allocations;
+        pmr_string c = std::move(b);
+        ASSERT(arena.allocations == before_move && c->get_allocator().resource() == &arena,
+               "move construction should take value along with allocator");
+
+        pmr_string other(std::allocator_arg, elsewhere, pd::in_place, 3, 'x');
+        c = other;
+        ASSERT(c.get_allocator().resource() == &arena && c->get_allocator().resource() == &arena && c == "xxx",
+               "copy assignment should preserve allocator of target");
+        c = text;
+        c.swap(other);
+        ASSERT(c == "xxx" && other == text, "swap should exchange values");
+        ASSERT(c->get_allocator().resource() == &arena && other->get_allocator().resource() == elsewhere,
+               "values should not cross unequal allocators on swap");
+        c = pd::nullopt;
+        swap(c, other);
+        REQUIRE(c == text && other == pd::nullopt && c->get_allocator().resource() == &arena);
+
+        std::pmr::vector<pmr_string> column(&arena);
+        column.reserve(4);
+        column.emplace_back(text);
+        column.emplace_back(pd::nullopt);
+        column.emplace_back();
+        column[1] = text;
+        column.push_back(column[0]);
+        for (const pmr_string &cell : column)
+        {
+            ASSERT(cell.get_allocator().resource() == &arena, "container should pass its resource down");
+            ASSERT(!cell || cell->get_allocator().resource() == &arena, "values should live in arena");
+        }
+        REQUIRE(!column[2] && column[3] == text);
+        ASSERT(fallback.allocations == 0, "nothing should reach default resource");
+    }
+    ASSERT(arena.allocations == arena.deallocations, "everything allocated in arena should be freed");
+
+    pd::allocator_optional<int, std::allocator<int>> number(std::allocator_arg, std::allocator<int>(), 5);
+    REQUIRE(number == 5 && number.value_or(0) == 5);
+    number.reset();
+    ASSERT_THROW(number.value(), pd::bad_optional_access, "empty allocator_optional should throw");
+
+    std::pmr::set_default_resource(previous);
+}
+
+// buffer without clear() member, recycled through its own traits
+struct ScratchBuffer
+{
+    std::vector<char> bytes;
+    std::size_t used = 0;
+};
+
+struct scratch_recycle
+{
+    static void clear(ScratchBuffer &buffer) noexcept
+    {
+        buffer.used = 0;
+    }
+};
+
+TEST(testRecyclingOptional)
+{
+    pd::recycling_optional<std::vector<int>> tokens;
+    REQUIRE(!tokens && !tokens.holds_object());
+    std::vector<int> &first = tokens.emplace();
+    for (int i = 0; i < 1000; ++i)
+        first.push_back(i);
+    const int *buffer = tokens->data();
+    const std::size_t capacity = tokens->capacity();
+    tokens.reset();
+    ASSERT(!tokens && tokens.holds_object(), "reset should keep object alive");
+    ASSERT_THROW(tokens.value(), pd::bad_optional_access, "recycled object is not a value");
+    std::vector<int> &second = tokens.emplace();
+    ASSERT(second.empty() && second.data() == buffer && second.capacity() == capacity,
+           "emplace should hand back cleared object with its capacity");
+    second.assign(10, 7);
+    tokens.emplace();
+    REQUIRE(tokens->empty() && tokens->data() == buffer);
+
+    pd::recycling_optional<std::string> line = std::string(100, 'a');
+    const char *chars = line->data();
+    line = pd::nullopt;
+    line = "short value";
+    ASSERT(line == "short value" && line->data() == chars, "assignment should reuse kept buffer");
+    line.reset();
+    line.emplace("another");
+    REQUIRE(line == "another" && line->data() == chars);
+    line.emplace(3, 'z');
+    REQUIRE(line == "zzz");
+
+    pd::recycling_optional<std::string> copy = line;
+    REQUIRE(copy == line && copy == "zzz");
+    line.reset();
+    pd::recycling_optional<std::string> empty_copy = line;
+    ASSERT(!empty_copy && !empty_copy.holds_object(), "copy should carry value, not capacity");
+    copy = line;
+    REQUIRE(!copy && copy.holds_object() && copy == line);
+    line.shrink();
+    ASSERT(!line && !line.holds_object(), "shrink should destroy kept object");
+    line = "back";
+    swap(line, copy);
+    REQUIRE(!line && line.holds_object() && copy == "back");
+
+    pd::recycling_optional<ScratchBuffer, scratch_recycle> scratch;
+    scratch.emplace().bytes.resize(64);
+    scratch->used = 64;
+    scratch.reset();
+    scratch.emplace();
+    ASSERT(scratch->used == 0 && scratch->bytes.size() == 64, "custom clear should decide what is kept");
+
+    pd::recycling_optional<int> number = 5;
+    number.reset();
+    REQUIRE(number.value_or(9) == 9 && number.holds_object());
+}
+
+// large payload which counts live instances and can refuse construction
+struct BigStats
+{
+    static int alive;
+
+    explicit BigStats(double first = 0, bool fail = false)
+    {
+        if (fail)
+            throw std::runtime_error("refused");
+        sums[0] = first;
+        ++alive;
+    }
+    BigStats(const BigStats &other) : BigStats(other.sums[0]) {}
+    BigStats& operator= (const BigStats&) = default;
+    ~BigStats() { --alive; }
+
+    bool operator== (const BigStats &other) const { return sums[0] == other.sums[0]; }
+    bool operator< (const BigStats &other) const { return sums[0] < other.sums[0]; }
+
+    double sums[256] = {};
+};
+
+int BigStats::alive = 0;
+
+TEST(testBoxedOptional)
+{
+    static_assert(sizeof(pd::boxed_optional<BigStats>) == sizeof(void*), "boxed optional should be pointer sized");
+    {
+        pd::boxed_optional<BigStats> stats;
+        REQUIRE(!stats && stats == pd::nullopt && BigStats::alive == 0);
+        ASSERT_THROW(stats.value(), pd::bad_optional_access, "empty boxed optional should throw");
+        stats.emplace(1.5);
+        REQUIRE(stats && stats->sums[0] == 1.5 && BigStats::alive == 1);
+        const BigStats *box = &*stats;
+        stats.reset();
+        REQUIRE(!stats && BigStats::alive == 0);
+        stats.emplace(2.5);
+        ASSERT(&*stats == box, "released block should be reused first");
+
+        pd::boxed_optional<BigStats> copy = stats;
+        REQUIRE(copy == stats && &*copy != &*stats && BigStats::alive == 2);
+        pd::boxed_optional<BigStats> moved = std::move(copy);
+        ASSERT(!copy && &*moved != box && BigStats::alive == 2, "move should steal the box");
+        moved = BigStats(0.5);
+        REQUIRE(moved < stats && moved != stats && BigStats::alive == 2);
+        swap(moved, copy);
+        REQUIRE(!moved && copy == BigStats(0.5));
+
+        const BigStats *before = &*stats;
+        ASSERT_THROW(stats.emplace(9.0, true), std::runtime_error, "failed construction should throw");
+        REQUIRE(!stats && BigStats::alive == 1);
+        stats.emplace(3.0);
+        ASSERT(&*stats == before, "block of failed construction should return to pool");
+
+        pd::boxed_optional<BigStats> from_inline = pd::optional<BigStats>(pd::in_place, 4.0);
+        REQUIRE(from_inline->sums[0] == 4.0);
+        auto first = from_inline.transform([](const BigStats &s) { return s.sums[0]; });
+        static_assert(std::is_same<decltype(first), pd::boxed_optional<double>>::value,
+                "transform should box its result");
+        REQUIRE(first == 4.0 && moved.transform([](const BigStats &s) { return s.sums[0]; }) == pd::nullopt);
+        auto half = first.and_then([](double v) { return pd::optional<double>(v / 2); });
+        REQUIRE(half == 2.0);
+        REQUIRE(moved.value_or_else([] { return BigStats(7.0); }).sums[0] == 7.0);
+    }
+    ASSERT(BigStats::alive == 0, "every boxed value should be destroyed");
+
+    std::vector<pd::boxed_optional<std::string>> handed;
+    std::thread producer([&]
+    {
+        for (int i = 0; i < 1000; ++i)
+            handed.emplace_back(std::to_string(i));
+    });
+    producer.join();
+    ASSERT(handed[999] == "999", "boxes should outlive thread which allocated them");
+    handed.clear();
+    pd::boxed_optional<std::string> reused = std::string("again");
+    REQUIRE(reused == "again");
+
+    // thread_local engaged before the pool's first use on its thread is
+    // destroyed after pool teardown, its block must still reach shared list
+    struct Shape { char bytes[3000]; };
+    const void *late_block = nullptr;
+    std::thread late([&]
+    {
+        static thread_local pd::boxed_optional<Shape> late_box;
+        late_box.emplace();
+        late_block = &*late_box;
+    });
+    late.join();
+    std::vector<pd::boxed_optional<Shape>> drained(pd::detail::box_pool_of_<Shape>::batch);
+    bool returned = false;
+    for (auto &box : drained)
+        returned |= &box.emplace() == late_block;
+    ASSERT(returned, "box destroyed after thread teardown should return to shared list");
+}
+
+TEST(testSharedOptional)
+{
+    pd::shared_optional<std::vector<std::string>> schema;
+    REQUIRE(!schema && schema == pd::nullopt && schema.use_count() == 0);
+    ASSERT_THROW(schema.mutate(), pd::bad_optional_access, "mutate of empty should throw");
+    schema.emplace(3, "column").push_back("extra");
+    REQUIRE(schema->size() == 4 && schema.unique());
+
+    pd::shared_optional<std::vector<std::string>> copy = schema;
+    ASSERT(&*copy == &*schema && schema.use_count() == 2 && !schema.unique(),
+           "copy should share the block");
+    copy.mutate().push_back("changed");
+    ASSERT(&*copy != &*schema && copy->size() == 5 && schema->size() == 4,
+           "mutate of shared value should copy it first");
+    REQUIRE(schema.unique() && copy.unique());
+    const std::string *first = &(*copy)[0];
+    copy.mutate()[0] = "renamed";
+    ASSERT(&(*copy)[0] == first, "sole holder should mutate in place");
+
+    pd::shared_optional<std::vector<std::string>> moved = std::move(copy);
+    REQUIRE(!copy && moved.unique() && (*moved)[0] == "renamed");
+    copy = moved;
+    moved = std::vector<std::string>{"fresh"};
+    ASSERT(copy->size() == 5 && moved == std::vector<std::string>{"fresh"},
+           "assigning value to shared holder should leave others alone");
+    moved = std::vector<std::string>{"again"};
+    REQUIRE(moved.unique() && (*moved)[0] == "again");
+    swap(moved, copy);
+    REQUIRE(moved->size() == 5 && copy != moved);
+    copy = pd::nullopt;
+    REQUIRE(!copy && copy.value_or(std::vector<std::string>{}).empty());
+
+    pd::shared_optional<int> number = pd::optional<int>(5);
+    pd::shared_optional<int> same = number;
+    REQUIRE(number == same && number == 5 && number.use_count() == 2);
+
+    std::vector<std::thread> workers;
+    std::atomic<std::size_t> columns {0};
+    for (int t = 0; t < 8; ++t)
+        workers.emplace_back([&columns, snapshot = schema]
+        {
+            for (int i = 0; i < 1000; ++i)
+            {
+                pd::shared_optional<std::vector<std::string>> local = snapshot;
+                columns.fetch_add(local->size(), std::memory_order_relaxed);
+            }
+        });
+    for (auto &w : workers)
+        w.join();
+    ASSERT(columns == 8 * 1000 * 4 && schema.unique(), "every thread should release what it copied");
+}
+
 int main()
 {
     testAssigment();
+    testAssignmentTransitions();
     testTriviality();
     testTypeProperties();
+    testTrivialityMatrix();
+    testRelocation();
+    testReferenceOptional();
+    testSentinelStorage();
+    testOptionalVector();
+    testColumnKernels();
+    testMonadic();
+    testAtomicOptional();
+    testOnceOptional();
+    testLazy();
+    testOptionalFields();
+    testSparseOptionalArray();
+    testColumnFile();
+    testParseOptional();
+    testHashAndFlatMap();
+    testSwap();
+    testSortOptionals();
+    testConstexpr();
+    testAllocatorOptional();
+    testRecyclingOptional();
+    testBoxedOptional();
+    testSharedOptional();
 
     if (is_failed)
         exit(1);
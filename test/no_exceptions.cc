@@ -0,0 +1,31 @@
+// built with -fno-exceptions, access to empty optional must end up
+// in the installed handler instead of throwing
+#include <cstdlib>
+#include <iostream>
+
+#include "../include/pd/optional.hh"
+
+#ifndef PD_OPTIONAL_NO_EXCEPTIONS
+#error "PD_OPTIONAL_NO_EXCEPTIONS should be defined with -fno-exceptions"
+#endif
+
+void on_bad_access()
+{
+    std::cout << " ----- RUNNING testNoExceptions ----- \n";
+    std::_Exit(0);
+}
+
+int main()
+{
+    pd::optional<int> engaged = 1;
+    if (engaged.value() != 1)
+        return 1;
+    if (pd::set_bad_access_handler(on_bad_access) != nullptr)
+        return 1;
+
+    pd::optional<int> empty;
+    volatile int v = empty.value();
+    (void)v;
+    std::cerr << "value() of empty optional returned\n";
+    return 1;
+}